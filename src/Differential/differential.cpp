@@ -0,0 +1,490 @@
+#include "differential.h"
+#include "../Lexer/lexer.h"
+#include "../Embedded/programs.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+
+DifferentialSuite::DifferentialSuite(const std::string& directory, unsigned int seed) :
+	corpusDirectory(directory), random(seed)
+{
+	engines.push_back({ "reference", ScanLevel::Scalar, ParserEngine::RecursiveDescent });
+	engines.push_back({ "table", ScanLevel::Scalar, ParserEngine::Table });
+
+	// more threads than cores, so even short programs are split
+	DifferentialEngine parallel;
+	parallel.name = "parallel";
+	parallel.parser = ParserEngine::Parallel;
+	parallel.threads = 4;
+	engines.push_back(parallel);
+
+	// the best kernels of this CPU, when they are not the scalar ones
+	const ScanKernels& best = getScanKernels();
+	if (best.level != ScanLevel::Scalar)
+		engines.push_back({ best.name, best.level, ParserEngine::RecursiveDescent });
+
+	DifferentialEngine embedded;
+	embedded.name = "constexpr";
+	embedded.embedded = true;
+	engines.push_back(embedded);
+}
+
+void DifferentialSuite::loadCorpus()
+{
+	std::error_code ec;
+	std::vector<std::string> files;
+
+	std::filesystem::recursive_directory_iterator i(corpusDirectory, ec), end;
+	for (; i != end; i.increment(ec))
+	{
+		std::string path = i->path().string();
+		if (i->is_regular_file(ec) && path.size() > 4 && path.compare(path.size() - 4, 4, ".sig") == 0)
+			files.push_back(path);
+	}
+
+	// the same seed gives the same inputs
+	std::sort(files.begin(), files.end());
+
+	for (auto const& path : files)
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::stringstream text;
+		text << in.rdbuf();
+		corpus.push_back({ path, text.str() });
+	}
+}
+
+// a program from the grammar, with comments, inserts and uneven whitespace
+std::string DifferentialSuite::generate()
+{
+	auto pick = [&](int n) { return (int)(random() % (unsigned int)n); };
+
+	auto identifier = [&]()
+	{
+		static const char* names[] = { "X", "Y", "VAR", "A1", "Z9Z", "LONGIDENTIFIER", "x", "In", "ENDX" };
+		return std::string(names[pick(9)]);
+	};
+
+	auto constant = [&]() { return std::to_string(pick(300)); };
+
+	auto space = [&]()
+	{
+		static const char* spaces[] = { " ", "  ", "\t", "\n", "\r\n", " (* c *) ", "\n\t\t" };
+		return std::string(spaces[pick(7)]);
+	};
+
+	std::string s = "PROGRAM" + space() + identifier() + ";" + space() + "BEGIN" + space();
+
+	int statements = pick(40);
+	for (int i = 0; i < statements; i++)
+	{
+		while (pick(4) == 0)
+			s += constant() + space() + ":" + space();
+
+		switch (pick(9))
+		{
+		case 0: s += identifier() + space() + ":=" + space() + constant() + ";"; break;
+		case 1: s += "GOTO " + constant() + ";"; break;
+		case 2: s += "LINK " + identifier() + "," + space() + constant() + ";"; break;
+		case 3: s += "IN " + constant() + ";"; break;
+		case 4: s += "OUT " + constant() + ";"; break;
+		case 5: s += "RETURN;"; break;
+		case 6: s += ";"; break;
+		case 7: s += "($" + space() + identifier() + space() + "$)"; break;
+		default:
+			s += identifier();
+			if (pick(2) == 0)
+			{
+				int arguments = pick(4);
+				s += space() + "(";
+				for (int a = 0; a <= arguments; a++)
+					s += (a > 0 ? "," + space() : "") + identifier();
+				s += ")";
+			}
+			s += ";";
+		}
+
+		s += space();
+	}
+
+	return s + "END;" + (pick(2) == 0 ? "\n" : "");
+}
+
+// small edits that lead into the error paths of the lexer and the parser
+std::string DifferentialSuite::mutate(const std::string& source)
+{
+	static const char* fragments[] = { "(", ")", "*", "(*", "*)", "$", "($", "$)", ":", ":=", ";", ",",
+		"\t", "\n", " ", "0", "9", "A", "z", "#", "\x80", "\xff", "END", "BEGIN", "PROGRAM", "GOTO" };
+
+	std::string s = source;
+	int edits = 1 + (int)(random() % 4);
+
+	for (int i = 0; i < edits; i++)
+	{
+		size_t at = s.empty() ? 0 : random() % (s.size() + 1);
+		size_t length = std::min<size_t>(1 + random() % 8, s.size() - std::min(at, s.size()));
+
+		switch (random() % 5)
+		{
+		case 0: s.erase(at, length); break;
+		case 1: s.insert(at, fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))]); break;
+		case 2: s.insert(at, s.substr(at, length)); break;
+		case 3: s.resize(at); break;
+		default:
+			if (length > 0)
+				s[at] = fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))][0];
+		}
+	}
+
+	return s;
+}
+
+CompilationSnapshot DifferentialSuite::compile(const std::string& source, DifferentialEngine& engine)
+{
+	if (engine.embedded)
+		return compileEmbedded(source, engine);
+
+	CompilationSnapshot result;
+
+	auto start = std::chrono::steady_clock::now();
+	Lexer lexer;
+	lexer.setScanLevel(engine.scan);
+	lexer.analyzeSource(source);
+	std::chrono::duration<double> lexing = std::chrono::steady_clock::now() - start;
+	engine.lexerSeconds += lexing.count();
+
+	std::ostringstream tokens;
+	for (auto const& t : lexer.tokens)
+	{
+		Position p = lexer.getPosition(t.offset);
+		tokens << p.row << "\t" << p.col << "\t" << t.id << "\t" << t.value << "\n";
+	}
+	for (auto const& e : lexer.errors)
+		tokens << e;
+	result.tokens = tokens.str();
+	result.lexerErrors = !lexer.errors.empty();
+
+	std::ostringstream tables;
+	for (size_t i = 0; i < lexer.constantsById.size(); i++)
+		tables << 501 + i << "\t" << lexer.constantsById[i] << "\n";
+	for (size_t i = 0; i < lexer.identifiersById.size(); i++)
+		tables << 1001 + i << "\t" << lexer.identifiersById[i] << "\n";
+	result.tables = tables.str();
+
+	std::ostringstream tree;
+	std::ostringstream diagnostics;
+	TreePrinter printer(tree);
+
+	start = std::chrono::steady_clock::now();
+	{
+		Parser par(SourceText{ source }, "", "");
+		par.setScanLevel(engine.scan);
+		par.setEngine(engine.parser);
+		par.setThreads(engine.threads);
+		par.setStatementsPerThread(1);
+		par.setListener(&printer);
+		par.startParsing();
+		par.printErrors(diagnostics);
+	}
+	std::chrono::duration<double> compiling = std::chrono::steady_clock::now() - start;
+	engine.compileSeconds += compiling.count();
+
+	result.tree = tree.str();
+	result.diagnostics = diagnostics.str();
+
+	return result;
+}
+
+CompilationSnapshot DifferentialSuite::compileEmbedded(const std::string& source, DifferentialEngine& engine)
+{
+	auto start = std::chrono::steady_clock::now();
+	{
+		EmbeddedAnalysis lexed;
+		EmbeddedLexer lexer(source);
+		lexer.run(lexed);
+	}
+	std::chrono::duration<double> lexing = std::chrono::steady_clock::now() - start;
+	engine.lexerSeconds += lexing.count();
+
+	start = std::chrono::steady_clock::now();
+	EmbeddedAnalysis a = analyzeEmbedded(source);
+	std::chrono::duration<double> compiling = std::chrono::steady_clock::now() - start;
+	engine.compileSeconds += compiling.count();
+
+	CompilationSnapshot result = snapshotOf({ source, a.tokens.data(), a.tokens.size(), a.nodes.data(), a.nodes.size() });
+	if (a.error == EmbeddedError::None)
+		return result;
+
+	// only the first diagnostic, the partial tree is not comparable
+	Position p = embeddedPosition(source, a.errorOffset);
+	result.tree.clear();
+	result.lexerErrors = a.error == EmbeddedError::IllegalCharacter || a.error == EmbeddedError::DollarWithoutParenthesis ||
+		a.error == EmbeddedError::UnterminatedComment;
+
+	if (result.lexerErrors)
+		result.diagnostics = "Lexer: Error (line " + std::to_string(p.row) + ", column " + std::to_string(p.col) + "): "
+			+ embeddedErrorText(a.error) + "\n";
+	else
+		result.diagnostics = "Parser: Error (Line " + std::to_string(p.row) + ", Column " + std::to_string(p.col) + "): "
+			+ embeddedErrorText(a.error) + "\n";
+
+	return result;
+}
+
+// the same text compile() makes of a runtime compilation
+CompilationSnapshot DifferentialSuite::snapshotOf(const EmbeddedView& program)
+{
+	CompilationSnapshot result;
+
+	std::ostringstream tokens;
+	std::vector<std::string_view> constants;
+	std::vector<std::string_view> identifiers;
+
+	for (size_t i = 0; i < program.tokenCount; i++)
+	{
+		const EmbeddedToken& t = program.tokens[i];
+		Position p = embeddedPosition(program.source, t.offset);
+		tokens << p.row << "\t" << p.col << "\t" << t.id << "\t" << t.value << "\n";
+
+		// ids are given in order of first appearance
+		if (t.id >= 501 && t.id <= 1000 && t.id - 501 == (int)constants.size())
+			constants.push_back(t.value);
+		else if (t.id >= 1001 && t.id - 1001 == (int)identifiers.size())
+			identifiers.push_back(t.value);
+	}
+	result.tokens = tokens.str();
+
+	std::ostringstream tables;
+	for (size_t i = 0; i < constants.size(); i++)
+		tables << 501 + i << "\t" << constants[i] << "\n";
+	for (size_t i = 0; i < identifiers.size(); i++)
+		tables << 1001 + i << "\t" << identifiers[i] << "\n";
+	result.tables = tables.str();
+
+	std::ostringstream tree;
+	TreePrinter printer(tree);
+	replayEmbedded(program, printer);
+	result.tree = tree.str();
+
+	return result;
+}
+
+// first differing line of the first differing part, "" when they agree;
+// firstError compares programs with errors only by their first diagnostic
+std::string DifferentialSuite::difference(const CompilationSnapshot& reference, const CompilationSnapshot& other, bool firstError)
+{
+	if (firstError && (!reference.diagnostics.empty() || !other.diagnostics.empty()))
+	{
+		// after a lexer error the runtime lexer goes on and the constexpr one stops
+		if (reference.lexerErrors || other.lexerErrors)
+		{
+			if (reference.lexerErrors == other.lexerErrors)
+				return "";
+			return std::string("diagnostics differ: ") + (reference.lexerErrors ? "lexer errors" : "no lexer errors")
+				+ " vs " + (other.lexerErrors ? "lexer errors" : "no lexer errors");
+		}
+
+		CompilationSnapshot a = reference;
+		CompilationSnapshot b = other;
+		a.tree.clear();
+		b.tree.clear();
+		return difference(a, b, false);
+	}
+
+	const std::pair<const char*, const std::string*> parts[][2] = {
+		{ { "tokens", &reference.tokens }, { "", &other.tokens } },
+		{ { "symbol tables", &reference.tables }, { "", &other.tables } },
+		{ { "tree", &reference.tree }, { "", &other.tree } },
+		{ { "diagnostics", &reference.diagnostics }, { "", &other.diagnostics } },
+	};
+
+	for (auto const& part : parts)
+	{
+		const std::string& a = *part[0].second;
+		const std::string& b = *part[1].second;
+		if (a == b)
+			continue;
+
+		std::istringstream left(a), right(b);
+		std::string l, r;
+		int line = 1;
+		while (true)
+		{
+			bool moreLeft = (bool)std::getline(left, l);
+			bool moreRight = (bool)std::getline(right, r);
+			if (!moreLeft)
+				l = "<end>";
+			if (!moreRight)
+				r = "<end>";
+
+			if (l != r || (!moreLeft && !moreRight))
+				break;
+			line++;
+		}
+
+		return std::string(part[0].first) + " differ at line " + std::to_string(line) + ": '" + l + "' vs '" + r + "'";
+	}
+
+	return "";
+}
+
+bool DifferentialSuite::check(const Input& input)
+{
+	CompilationSnapshot reference = compile(input.source, engines[0]);
+	bool agreed = true;
+
+	for (size_t e = 1; e < engines.size(); e++)
+	{
+		std::string diff = difference(reference, compile(input.source, engines[e]), engines[e].embedded);
+		if (diff.empty())
+			continue;
+
+		engines[e].diverged++;
+		agreed = false;
+
+		std::string minimal = minimize(input.source, e);
+		save(minimal, engines[e], diff);
+
+		std::cout << "Differential: " << engines[e].name << " diverges on " << input.origin << ": " << diff
+			<< ", minimized to " << minimal.size() << " bytes" << std::endl;
+	}
+
+	return agreed;
+}
+
+// delta debugging: drops ever smaller parts while the engines still disagree
+std::string DifferentialSuite::minimize(const std::string& source, size_t e)
+{
+	DifferentialEngine reference = engines[0];
+	DifferentialEngine other = engines[e];
+
+	auto diverges = [&](const std::string& s)
+	{
+		return !difference(compile(s, reference), compile(s, other), other.embedded).empty();
+	};
+
+	std::string s = source;
+	size_t parts = 2;
+	int steps = 0;
+
+	while (s.size() >= 2 && steps < maxMinimizeSteps)
+	{
+		size_t chunk = (s.size() + parts - 1) / parts;
+		bool reduced = false;
+
+		for (size_t from = 0; from < s.size() && steps < maxMinimizeSteps; from += chunk, steps++)
+		{
+			std::string candidate = s.substr(0, from) + s.substr(std::min(s.size(), from + chunk));
+			if (diverges(candidate))
+			{
+				s = candidate;
+				parts = std::max<size_t>(parts - 1, 2);
+				reduced = true;
+				break;
+			}
+		}
+
+		if (!reduced)
+		{
+			if (parts >= s.size())
+				break;
+			parts = std::min(parts * 2, s.size());
+		}
+	}
+
+	return s;
+}
+
+// programs compiled into the binary must match what the runtime parser makes of their source
+bool DifferentialSuite::checkEmbedded()
+{
+	bool agreed = true;
+	double replaySeconds = 0;
+	double compileSeconds = 0;
+
+	for (auto const& entry : embeddedPrograms)
+	{
+		std::string source(entry.program.source);
+		DifferentialEngine reference = engines[0];
+		reference.compileSeconds = 0;
+		CompilationSnapshot compiled = compile(source, reference);
+		compileSeconds += reference.compileSeconds;
+
+		auto start = std::chrono::steady_clock::now();
+		CompilationSnapshot baked = snapshotOf(entry.program);
+		std::chrono::duration<double> replaying = std::chrono::steady_clock::now() - start;
+		replaySeconds += replaying.count();
+
+		std::string diff = difference(compiled, baked, false);
+		if (!diff.empty())
+		{
+			std::cout << "Differential: embedded program '" << entry.name << "' diverges: " << diff << std::endl;
+			agreed = false;
+		}
+	}
+
+	std::cout << "Differential: " << sizeof(embeddedPrograms) / sizeof(embeddedPrograms[0]) << " embedded programs, "
+		<< "replayed in " << replaySeconds * 1000 << " ms, compiling them takes " << compileSeconds * 1000 << " ms" << std::endl;
+
+	return agreed;
+}
+
+void DifferentialSuite::save(const std::string& source, const DifferentialEngine& engine, const std::string& diff)
+{
+	std::error_code ec;
+	std::filesystem::path directory = std::filesystem::path(corpusDirectory) / "diverged";
+	std::filesystem::create_directories(directory, ec);
+
+	std::string name = engine.name + "-" + std::to_string(std::hash<std::string>()(source) % 1000000);
+
+	std::ofstream out(directory / (name + ".sig"), std::ios::binary);
+	out << source;
+
+	std::ofstream note(directory / (name + ".txt"));
+	note << engine.name << ": " << diff << std::endl;
+	saved++;
+}
+
+bool DifferentialSuite::run(size_t count)
+{
+	loadCorpus();
+	size_t corpusSize = corpus.size();
+
+	std::vector<Input> inputs = corpus;
+	for (size_t i = 0; i < count; i++)
+		inputs.push_back({ "generated " + std::to_string(generated++), generate() });
+
+	// mutations of the corpus and of the generated programs
+	for (size_t i = 0; i < count * 4 && !inputs.empty(); i++)
+	{
+		const Input& base = inputs[random() % (corpusSize + count)];
+		inputs.push_back({ "mutated " + std::to_string(mutated++) + " of " + base.origin, mutate(base.source) });
+	}
+
+	size_t failed = checkEmbedded() ? 0 : 1;
+	for (auto const& input : inputs)
+	{
+		if (!check(input))
+			failed++;
+	}
+
+	std::cout << "Differential: " << corpusSize << " corpus, " << generated << " generated, "
+		<< mutated << " mutated inputs, " << failed << " diverging";
+	if (saved > 0)
+		std::cout << ", saved to " << (std::filesystem::path(corpusDirectory) / "diverged").string();
+	std::cout << std::endl;
+
+	const DifferentialEngine& reference = engines[0];
+	for (auto const& e : engines)
+	{
+		std::cout << e.name << ":\t" << e.diverged << " diverging\tlexer " << e.lexerSeconds * 1000 << " ms (x"
+			<< reference.lexerSeconds / e.lexerSeconds << ")\tcompile " << e.compileSeconds * 1000 << " ms (x"
+			<< reference.compileSeconds / e.compileSeconds << ")" << std::endl;
+	}
+
+	return failed == 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "../Lexer/scan.h"
+#include "../Parser/parser.h"
+#include "../Embedded/embedded.h"
+
+#include <string>
+#include <vector>
+#include <random>
+
+// One way of compiling a program: lexer scan kernels and parser engine
+struct DifferentialEngine
+{
+	std::string name = "";
+	ScanLevel scan = ScanLevel::Scalar;
+	ParserEngine parser = ParserEngine::RecursiveDescent;
+	bool embedded = false; // the constexpr lexer and parser, run at runtime
+	unsigned int threads = 0; // parallel parser, split down to single statements
+
+	double lexerSeconds = 0;
+	double compileSeconds = 0;
+	size_t diverged = 0;
+};
+
+// Everything a compilation produces, as text that can be compared
+struct CompilationSnapshot
+{
+	std::string tokens;
+	std::string tables; // constants and identifiers by id
+	std::string tree;
+	std::string diagnostics;
+	bool lexerErrors = false;
+};
+
+// Runs the reference lexer and parser (scalar kernels, recursive descent)
+// and every other engine on the corpus, generated programs and mutations of
+// both, and compares tokens, symbol tables, trees and diagnostics. The
+// constexpr engine stops at its first error, so on programs with errors only
+// that diagnostic is compared. Diverging inputs are minimized and saved to
+// <corpus>/diverged/, where later runs pick them up as part of the corpus.
+class DifferentialSuite
+{
+private:
+	struct Input
+	{
+		std::string origin; // file name, "generated n" or "mutated n"
+		std::string source;
+	};
+
+	std::string corpusDirectory;
+	std::vector<DifferentialEngine> engines; // the first one is the reference
+	std::vector<Input> corpus;
+	std::mt19937 random;
+
+	size_t generated = 0;
+	size_t mutated = 0;
+	size_t saved = 0;
+	int maxMinimizeSteps = 2000;
+
+public:
+	DifferentialSuite(const std::string&, unsigned int);
+
+	// false when any engine diverges from the reference
+	bool run(size_t);
+
+private:
+	void loadCorpus();
+	std::string generate();
+	std::string mutate(const std::string&);
+
+	static CompilationSnapshot compile(const std::string&, DifferentialEngine&);
+	static CompilationSnapshot compileEmbedded(const std::string&, DifferentialEngine&);
+	static CompilationSnapshot snapshotOf(const EmbeddedView&);
+	static std::string difference(const CompilationSnapshot&, const CompilationSnapshot&, bool);
+
+	bool checkEmbedded();
+
+	bool check(const Input&);
+	std::string minimize(const std::string&, size_t);
+	void save(const std::string&, const DifferentialEngine&, const std::string&);
+};
@@ -0,0 +1,54 @@
+#include "embedded.h"
+
+#include <string>
+
+void replayEmbedded(const EmbeddedView& program, ParseListener& out)
+{
+	std::vector<int> ends; // open nonterminals
+
+	for (int i = 0; i < (int)program.nodeCount; i++)
+	{
+		while (!ends.empty() && ends.back() == i)
+		{
+			out.leave();
+			ends.pop_back();
+		}
+
+		const EmbeddedNode& n = program.nodes[i];
+		if (n.id != 0 || n.value == "<empty>")
+			out.terminal(n.id, std::string(n.value), n.offset);
+		else
+		{
+			out.enter(std::string(n.value));
+			ends.push_back(n.end);
+		}
+	}
+
+	for (size_t i = 0; i < ends.size(); i++)
+		out.leave();
+}
+
+const char* embeddedErrorText(EmbeddedError error)
+{
+	switch (error)
+	{
+	case EmbeddedError::None: return "";
+	case EmbeddedError::IllegalCharacter: return "illegal character";
+	case EmbeddedError::DollarWithoutParenthesis: return "expected \")\" after $";
+	case EmbeddedError::UnterminatedComment: return "expected *), but found the end of file";
+	case EmbeddedError::ProgramExpected: return "keyword 'PROGRAM' expected.";
+	case EmbeddedError::SemicolonExpected: return "';' expected.";
+	case EmbeddedError::BeginExpected: return "keyword 'BEGIN' expected.";
+	case EmbeddedError::EndExpected: return "keyword 'END' expected.";
+	case EmbeddedError::IdentifierExpected: return "<identifier> expected.";
+	case EmbeddedError::UnsignedIntegerExpected: return "<unsigned-integer> expected.";
+	case EmbeddedError::ColonExpected: return "':' expected.";
+	case EmbeddedError::CommaExpected: return "',' expected.";
+	case EmbeddedError::AssemblyEndExpected: return "'$)' expected.";
+	case EmbeddedError::StatementExpected: return "<statement> expected.";
+	case EmbeddedError::ActualArgumentsExpected: return "<actual-arguments> expected.";
+	case EmbeddedError::ParenthesisExpected: return "')' expected.";
+	}
+
+	return "";
+}
@@ -0,0 +1,638 @@
+#pragma once
+
+#include "../Parser/parser.h"
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// SIGNAL programs embedded as string literals, lexed and parsed by the
+// compiler (C++20). A program with errors does not compile, and a valid one
+// becomes a token array and a tree array in read-only data:
+//
+//	constexpr EmbeddedView program = EmbeddedProgram<"PROGRAM P; BEGIN END;">::view;
+//
+// Tokens, ids and tree follow the runtime lexer and parser exactly, so the
+// program replays into a ParseListener like a parsed one.
+
+enum class EmbeddedError
+{
+	None,
+	IllegalCharacter,
+	DollarWithoutParenthesis, // "$" not followed by ")"
+	UnterminatedComment,
+	ProgramExpected,
+	SemicolonExpected,
+	BeginExpected,
+	EndExpected,
+	IdentifierExpected,
+	UnsignedIntegerExpected,
+	ColonExpected,
+	CommaExpected,
+	AssemblyEndExpected, // "$)"
+	StatementExpected,
+	ActualArgumentsExpected,
+	ParenthesisExpected // ")"
+};
+
+struct EmbeddedToken
+{
+	int offset = 0;
+	int id = 0;
+	std::string_view value;
+};
+
+// tree in preorder, a node's subtree ends before the node at index end
+struct EmbeddedNode
+{
+	std::string_view value;
+	int id = 0; // 0 for nonterminals and <empty>
+	int offset = -1;
+	int end = 0;
+};
+
+struct EmbeddedView
+{
+	std::string_view source;
+	const EmbeddedToken* tokens = nullptr;
+	size_t tokenCount = 0;
+	const EmbeddedNode* nodes = nullptr;
+	size_t nodeCount = 0;
+};
+
+struct EmbeddedAnalysis
+{
+	std::vector<EmbeddedToken> tokens;
+	std::vector<EmbeddedNode> nodes;
+	EmbeddedError error = EmbeddedError::None;
+	int errorOffset = -1;
+};
+
+// row and column the way Lexer::getPosition() counts them, {0, 0} before the first token
+constexpr Position embeddedPosition(std::string_view source, int offset)
+{
+	Position p;
+	if (offset < 0)
+		return p;
+
+	p.row = 1;
+	for (int i = 0; i <= offset && i < (int)source.size(); i++)
+	{
+		char c = source[i];
+		if (c == '\n')
+		{
+			p.row++;
+			p.col = 0;
+		}
+		else if (c == '\t')
+			p.col += 3;
+		else if (c < 8 || c > 13)
+			p.col += 1;
+	}
+
+	return p;
+}
+
+class EmbeddedLexer
+{
+private:
+	std::string_view source;
+	std::vector<std::string_view> constants;
+	std::vector<std::string_view> identifiers;
+
+public:
+	constexpr EmbeddedLexer(std::string_view s) : source(s) {}
+
+	constexpr void run(EmbeddedAnalysis& result)
+	{
+		size_t pos = 0;
+		while (pos < source.size() && result.error == EmbeddedError::None)
+		{
+			char c = source[pos];
+			size_t start = pos;
+
+			if (c == ' ' || (c >= 8 && c <= 13))
+			{
+				pos++;
+			}
+			else if (isDigit(c))
+			{
+				while (pos < source.size() && isDigit(source[pos]))
+					pos++;
+				std::string_view lexeme = source.substr(start, pos - start);
+				add(result, start, 501 + intern(constants, lexeme), lexeme);
+			}
+			else if (isLetter(c))
+			{
+				while (pos < source.size() && (isLetter(source[pos]) || isDigit(source[pos])))
+					pos++;
+				std::string_view lexeme = source.substr(start, pos - start);
+				int keyword = keywordId(lexeme);
+				add(result, start, keyword != 0 ? keyword : 1001 + intern(identifiers, lexeme), lexeme);
+			}
+			else if (c == ';' || c == ',' || c == ')')
+			{
+				add(result, start, c, source.substr(start, 1));
+				pos++;
+			}
+			else if (c == '$')
+			{
+				if (pos + 1 >= source.size() || source[pos + 1] != ')')
+					return fail(result, EmbeddedError::DollarWithoutParenthesis, pos + 1 < source.size() ? pos + 1 : pos);
+
+				add(result, start, 302, source.substr(start, 2));
+				pos += 2;
+			}
+			else if (c == ':')
+			{
+				bool assign = pos + 1 < source.size() && source[pos + 1] == '=';
+				add(result, start, assign ? 303 : 58, source.substr(start, assign ? 2 : 1));
+
+				// the runtime lexer drops the character after a lone ":" as well
+				pos = pos + 2 < source.size() ? pos + 2 : source.size();
+			}
+			else if (c == '(' && pos + 1 < source.size() && source[pos + 1] == '*')
+			{
+				size_t close = source.find("*)", pos + 2);
+				if (close == std::string_view::npos)
+					return fail(result, EmbeddedError::UnterminatedComment, source.size() - 1);
+
+				pos = close + 2;
+			}
+			else if (c == '(' && pos + 1 < source.size() && source[pos + 1] == '$')
+			{
+				add(result, start, 301, source.substr(start, 2));
+				pos += 2;
+			}
+			else if (c == '(')
+			{
+				add(result, start, 40, source.substr(start, 1));
+				pos++;
+			}
+			else
+				return fail(result, EmbeddedError::IllegalCharacter, pos);
+		}
+	}
+
+private:
+	static constexpr bool isDigit(char c) { return c >= '0' && c <= '9'; }
+	static constexpr bool isLetter(char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
+
+	static constexpr int keywordId(std::string_view lexeme)
+	{
+		constexpr std::string_view keywords[] = { "PROGRAM", "BEGIN", "END", "GOTO", "LINK", "IN", "OUT", "RETURN" };
+		for (int i = 0; i < 8; i++)
+		{
+			if (keywords[i] == lexeme)
+				return 401 + i;
+		}
+		return 0;
+	}
+
+	// index of the lexeme in first appearance order
+	static constexpr int intern(std::vector<std::string_view>& table, std::string_view lexeme)
+	{
+		for (size_t i = 0; i < table.size(); i++)
+		{
+			if (table[i] == lexeme)
+				return (int)i;
+		}
+
+		table.push_back(lexeme);
+		return (int)table.size() - 1;
+	}
+
+	static constexpr void add(EmbeddedAnalysis& result, size_t offset, int id, std::string_view value)
+	{
+		result.tokens.push_back({ (int)offset, id, value });
+	}
+
+	static constexpr void fail(EmbeddedAnalysis& result, EmbeddedError error, size_t offset)
+	{
+		result.error = error;
+		result.errorOffset = (int)offset;
+	}
+};
+
+// The recursive descent parser of parser.cpp, with the statement and argument
+// lists as loops so that long programs stay within the constexpr depth limit
+class EmbeddedParser
+{
+private:
+	EmbeddedAnalysis& result;
+	size_t index = 0;
+	int id = 0;
+	int offset = -1;
+	std::string_view value;
+
+public:
+	constexpr EmbeddedParser(EmbeddedAnalysis& r) : result(r) {}
+
+	constexpr void run()
+	{
+		int root = open("<signal-program>");
+		if (program())
+			close(root);
+	}
+
+private:
+	constexpr void next()
+	{
+		if (index < result.tokens.size())
+		{
+			id = result.tokens[index].id;
+			offset = result.tokens[index].offset;
+			value = result.tokens[index].value;
+			index++;
+		}
+		else
+			id = 0; // keeps the position of the last token
+	}
+
+	constexpr bool fail(EmbeddedError error)
+	{
+		result.error = error;
+		result.errorOffset = offset;
+		return false;
+	}
+
+	constexpr int open(std::string_view name)
+	{
+		result.nodes.push_back({ name, 0, -1, 0 });
+		return (int)result.nodes.size() - 1;
+	}
+
+	constexpr void close(int node)
+	{
+		result.nodes[node].end = (int)result.nodes.size();
+	}
+
+	constexpr void terminal()
+	{
+		result.nodes.push_back({ value, id, offset, (int)result.nodes.size() + 1 });
+	}
+
+	constexpr void empty()
+	{
+		result.nodes.push_back({ "<empty>", 0, -1, (int)result.nodes.size() + 1 });
+	}
+
+	constexpr bool expect(int token, EmbeddedError error)
+	{
+		if (id != token)
+			return fail(error);
+
+		terminal();
+		return true;
+	}
+
+	constexpr bool identifier(std::string_view kind)
+	{
+		int outer = open(kind);
+		int inner = open("<identifier>");
+
+		if (id < 1001)
+			return fail(EmbeddedError::IdentifierExpected);
+
+		terminal();
+		close(inner);
+		close(outer);
+		return true;
+	}
+
+	constexpr bool unsignedInteger()
+	{
+		int n = open("<unsigned-integer>");
+		if (id < 501 || id > 1000)
+			return fail(EmbeddedError::UnsignedIntegerExpected);
+
+		terminal();
+		close(n);
+		return true;
+	}
+
+	constexpr bool program()
+	{
+		int n = open("<program>");
+		next();
+
+		if (!expect(401, EmbeddedError::ProgramExpected))
+			return false;
+
+		next();
+		if (!identifier("<procedure-identifier>"))
+			return false;
+
+		next();
+		if (!expect(59, EmbeddedError::SemicolonExpected))
+			return false;
+
+		next();
+		if (!block())
+			return false;
+
+		next();
+		if (!expect(59, EmbeddedError::SemicolonExpected))
+			return false;
+
+		close(n);
+		return true;
+	}
+
+	constexpr bool block()
+	{
+		int n = open("<block>");
+		if (!expect(402, EmbeddedError::BeginExpected))
+			return false;
+
+		next();
+
+		// <statement-list> is <statement> <statement-list> or <empty>
+		std::vector<int> lists;
+		while (true)
+		{
+			lists.push_back(open("<statement-list>"));
+			if (id == 403)
+			{
+				empty();
+				break;
+			}
+
+			if (!statement())
+				return false;
+			next();
+		}
+
+		for (auto i = lists.rbegin(); i != lists.rend(); ++i)
+			close(*i);
+
+		if (!expect(403, EmbeddedError::EndExpected))
+			return false;
+
+		close(n);
+		return true;
+	}
+
+	constexpr bool statement()
+	{
+		// a labeled statement holds the statement after the label
+		std::vector<int> statements = { open("<statement>") };
+		while (id >= 501 && id <= 1000)
+		{
+			if (!unsignedInteger())
+				return false;
+
+			next();
+			if (!expect(58, EmbeddedError::ColonExpected))
+				return false;
+
+			next();
+			statements.push_back(open("<statement>"));
+		}
+
+		if (!unlabeledStatement())
+			return false;
+
+		for (auto i = statements.rbegin(); i != statements.rend(); ++i)
+			close(*i);
+		return true;
+	}
+
+	constexpr bool unlabeledStatement()
+	{
+		if (id >= 1001)
+		{
+			int following = index < result.tokens.size() ? result.tokens[index].id : 0;
+
+			if (following == 303) // <variable-identifier> := <unsigned-integer>
+			{
+				if (!identifier("<variable-identifier>"))
+					return false;
+
+				next();
+				terminal();
+
+				next();
+				if (!unsignedInteger())
+					return false;
+
+				next();
+				return expect(59, EmbeddedError::SemicolonExpected);
+			}
+
+			// <procedure-identifier> <actual-arguments>
+			if (!identifier("<procedure-identifier>"))
+				return false;
+
+			next();
+			if (!actualArguments())
+				return false;
+
+			return expect(59, EmbeddedError::SemicolonExpected);
+		}
+
+		switch (id)
+		{
+		case 404: // GOTO
+		case 406: // IN
+		case 407: // OUT
+			terminal();
+
+			next();
+			if (!unsignedInteger())
+				return false;
+
+			next();
+			return expect(59, EmbeddedError::SemicolonExpected);
+
+		case 405: // LINK
+			terminal();
+
+			next();
+			if (!identifier("<variable-identifier>"))
+				return false;
+
+			next();
+			if (!expect(44, EmbeddedError::CommaExpected))
+				return false;
+
+			next();
+			if (!unsignedInteger())
+				return false;
+
+			next();
+			return expect(59, EmbeddedError::SemicolonExpected);
+
+		case 408: // RETURN
+			terminal();
+
+			next();
+			return expect(59, EmbeddedError::SemicolonExpected);
+
+		case 59:
+			terminal();
+			return true;
+
+		case 301: // ($
+			terminal();
+
+			next();
+			if (!identifier("<assembly-insert-file-identifier>"))
+				return false;
+
+			next();
+			return expect(302, EmbeddedError::AssemblyEndExpected);
+
+		default:
+			return fail(EmbeddedError::StatementExpected);
+		}
+	}
+
+	constexpr bool actualArguments()
+	{
+		int n = open("<actual-arguments>");
+
+		if (id == 59)
+		{
+			empty();
+			close(n);
+			return true;
+		}
+
+		if (!expect(40, EmbeddedError::ActualArgumentsExpected))
+			return false;
+
+		next();
+		if (!identifier("<variable-identifier>"))
+			return false;
+
+		next();
+		if (id != 41)
+		{
+			// <actual-arguments-list> is , <variable-identifier> <actual-arguments-list> or <empty>
+			std::vector<int> lists;
+			while (true)
+			{
+				lists.push_back(open("<actual-arguments-list>"));
+				if (id != 44)
+				{
+					empty();
+					break;
+				}
+
+				terminal();
+
+				next();
+				if (!identifier("<variable-identifier>"))
+					return false;
+
+				next();
+				if (id == 41)
+					break;
+			}
+
+			for (auto i = lists.rbegin(); i != lists.rend(); ++i)
+				close(*i);
+		}
+
+		if (!expect(41, EmbeddedError::ParenthesisExpected))
+			return false;
+
+		next();
+		close(n);
+		return true;
+	}
+};
+
+constexpr EmbeddedAnalysis analyzeEmbedded(std::string_view source)
+{
+	EmbeddedAnalysis result;
+
+	EmbeddedLexer lexer(source);
+	lexer.run(result);
+
+	if (result.error == EmbeddedError::None)
+	{
+		EmbeddedParser parser(result);
+		parser.run();
+	}
+
+	return result;
+}
+
+struct EmbeddedSummary
+{
+	size_t tokens = 0;
+	size_t nodes = 0;
+	EmbeddedError error = EmbeddedError::None;
+	int line = 0;
+	int column = 0;
+};
+
+constexpr EmbeddedSummary summarizeEmbedded(std::string_view source)
+{
+	EmbeddedAnalysis a = analyzeEmbedded(source);
+	Position p = embeddedPosition(source, a.errorOffset);
+
+	return { a.tokens.size(), a.nodes.size(), a.error, p.row, p.col };
+}
+
+// fails the build with the line, column and error of the first diagnostic
+// in the instantiation of this template
+template <int Line, int Column, EmbeddedError Error>
+struct EmbeddedDiagnostic
+{
+	static_assert(Error == EmbeddedError::None, "SIGNAL: embedded program has errors (see Line, Column and Error)");
+	static constexpr bool ok = true;
+};
+
+// string literal as a template argument
+template <size_t N>
+struct FixedSource
+{
+	char text[N] = {};
+
+	constexpr FixedSource(const char (&s)[N])
+	{
+		for (size_t i = 0; i < N; i++)
+			text[i] = s[i];
+	}
+
+	constexpr std::string_view view() const { return { text, N - 1 }; }
+};
+
+template <FixedSource Source>
+class EmbeddedProgram
+{
+private:
+	static constexpr EmbeddedSummary summary = summarizeEmbedded(Source.view());
+	static_assert(EmbeddedDiagnostic<summary.line, summary.column, summary.error>::ok);
+
+	static constexpr std::array<EmbeddedToken, summary.tokens> tokens = []()
+	{
+		EmbeddedAnalysis a = analyzeEmbedded(Source.view());
+		std::array<EmbeddedToken, summary.tokens> t = {};
+		for (size_t i = 0; i < t.size(); i++)
+			t[i] = a.tokens[i];
+		return t;
+	}();
+
+	static constexpr std::array<EmbeddedNode, summary.nodes> nodes = []()
+	{
+		EmbeddedAnalysis a = analyzeEmbedded(Source.view());
+		std::array<EmbeddedNode, summary.nodes> n = {};
+		for (size_t i = 0; i < n.size(); i++)
+			n[i] = a.nodes[i];
+		return n;
+	}();
+
+public:
+	static constexpr EmbeddedView view = { Source.view(), tokens.data(), tokens.size(), nodes.data(), nodes.size() };
+};
+
+// the embedded tree as enter/leave/terminal events, no lexing or parsing
+void replayEmbedded(const EmbeddedView&, ParseListener&);
+
+// message of the parser or lexer diagnostic, e.g. "';' expected."
+const char* embeddedErrorText(EmbeddedError);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "embedded.h"
+
+struct EmbeddedEntry
+{
+	const char* name;
+	EmbeddedView program;
+};
+
+// programs built into the compiler, checked against the runtime parser by --differential
+inline constexpr EmbeddedEntry embeddedPrograms[] = {
+	{ "comments", EmbeddedProgram<
+		"PROGRAM MAIN;\n"
+		"\n"
+		"BEGIN\n"
+		"\t(* ** TestComment * ( )  \n"
+		"\t\t*\n"
+		"\t*)\n"
+		"\t\n"
+		"\tGOTO 2; (* *)\n"
+		"\t\n"
+		"\t(**)\n"
+		"\t(* ~ *)\n"
+		"END;">::view },
+
+	{ "calls", EmbeddedProgram<
+		"PROGRAM Test;\n"
+		"BEGIN\n"
+		"  A;\n"
+		"  B (r1, g, b44a);\n"
+		"END;\n">::view },
+
+	{ "statements", EmbeddedProgram<
+		"PROGRAM MAIN;\n"
+		"BEGIN\n"
+		"10: LINK X, 5;\n"
+		"\tIN 5;\n"
+		"\tV1 := 40;\n"
+		"\t($ INSERT1 $)\n"
+		"\tGOTO 10;\n"
+		"20: RETURN;\n"
+		"END;\n">::view },
+};
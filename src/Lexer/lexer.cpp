@@ -2,13 +2,38 @@
 
 #include <iostream>
 #include <algorithm>
-
-Lexer::Lexer() : row(1), col(1), attributes(), category()
+#include <cstring>
+#include <iterator>
+
+const std::unordered_map<std::string, int> Lexer::singleDelimiters = {
+	{ ";", 59},
+	{ ",", 44},
+	{ ")", 41},
+};
+
+const std::unordered_map<std::string, int> Lexer::multipleDelimiters = {
+	{ "($", 301},
+	{ "$)", 302},
+	{ ":=", 303}
+};
+
+const std::unordered_map<std::string, int> Lexer::keywords = {
+	{ "PROGRAM", 401 },
+	{ "BEGIN", 402 },
+	{ "END", 403 },
+	{ "GOTO", 404 },
+	{ "LINK", 405 },
+	{ "IN", 406 },
+	{ "OUT", 407 },
+	{ "RETURN", 408 },
+};
+
+Lexer::Lexer() : attributes(), category(), kernels(&getScanKernels()), pos(0), eof(false), cachedOffset(-1)
 {
 	initializeTables();
 }
 
-Lexer::Lexer(const std::string& filename) : row(1), col(1)
+Lexer::Lexer(const std::string& filename) : kernels(&getScanKernels()), pos(0), eof(false), cachedOffset(-1)
 {
 	inputFile.open(filename);
 
@@ -29,34 +54,13 @@ Lexer::~Lexer()
 
 void Lexer::initializeTables()
 {
-	singleDelimiters = {
-		{ ";", 59},
-		{ ",", 44},
-		{ ")", 41},
-	};
-
-	multipleDelimiters = {
-		{ "($", 301},
-		{ "$)", 302},
-		{ ":=", 303}
-	};
-
-	keywords = {
-		{ "PROGRAM", 401 },
-		{ "BEGIN", 402 },
-		{ "END", 403 },
-		{ "GOTO", 404 },
-		{ "LINK", 405 },
-		{ "IN", 406 },
-		{ "OUT", 407 },
-		{ "RETURN", 408 },
-	};
-
 	constants = {};
 	identifiers = {};
-	tokens = {};
+	constantsById = {};
+	identifiersById = {};
+	tokens.clear();
 
-	for (int i = 0; i < 255; i++)
+	for (int i = 0; i < 256; i++)
 	{
 		if (i == 32 || (i >= 8 && i <= 13))
 			attributes[i] = SymbolCategories::Whitespace;
@@ -84,7 +88,10 @@ void Lexer::initializeTables()
 
 void Lexer::startLexicalAnalyzer(const std::string& filename)
 {
-	inputFile.open(filename);
+	if (inputFile.is_open())
+		inputFile.close();
+
+	inputFile.open(filename, std::ios::binary);
 
 	if (!inputFile.is_open())
 	{
@@ -92,33 +99,173 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 		return;
 	}
 
-	Symbol s;
+	// directories open but can't be read
+	if (inputFile.peek() == std::ifstream::traits_type::eof() && inputFile.bad())
+	{
+		inputFile.close();
+		getErrors("empty file");
+		return;
+	}
+	inputFile.clear();
+
+	inputFile.seekg(0, std::ios::end);
+	std::streamoff size = inputFile.tellg();
+	if (size >= 0)
+	{
+		source.resize((size_t)size);
+		inputFile.seekg(0, std::ios::beg);
+		inputFile.read(&source[0], source.size());
+	}
+	else
+	{
+		// pipes and FIFOs can't seek, they are read to the end instead
+		inputFile.clear();
+		source.assign(std::istreambuf_iterator<char>(inputFile), std::istreambuf_iterator<char>());
+	}
+	inputFile.close();
+
+	analyze();
+}
+
+void Lexer::analyzeSource(std::string text)
+{
+	source = std::move(text);
+	analyze();
+}
+
+void Lexer::analyze()
+{
+	pos = 0;
+	eof = false;
+	streaming = false;
+	sourceBase = 0;
+	tokenBase = 0;
+	buildLineIndex();
+	references.clear();
+
+	lookahead = gets();
+	lexTokens((size_t)-1);
+
+	references.build(tokens);
+}
+
+void Lexer::openStream(const std::string& filename, const std::string& output)
+{
+	if (inputFile.is_open())
+		inputFile.close();
+
+	source.clear();
+	pos = 0;
+	eof = false;
+	streaming = true;
+	sourceBase = 0;
+	keepFrom = 0;
+	tokenBase = 0;
+	printed = 0;
+	trackedOffset = 0;
+	trackedPosition = { 1, 0 };
+	tokens.clear();
+	windowPositions.clear();
+	keptPositions.clear();
+	references.clear();
+	lineStarts.clear();
+	cachedOffset = -1;
+
+	outputPath = output;
+	outputFile.open(output);
+
+	inputFile.open(filename, std::ios::binary);
+
+	if (!inputFile.is_open())
+	{
+		getErrors("empty file");
+		eof = true;
+		return;
+	}
+
+	lookahead = gets();
+	lexTokens(StreamTokens);
+}
+
+const Token* Lexer::streamToken(size_t index)
+{
+	while (index >= tokenBase + tokens.size() && !eof)
+		nextBatch();
+
+	if (index < tokenBase || index >= tokenBase + tokens.size())
+		return nullptr;
+
+	return &tokens[index - tokenBase];
+}
+
+void Lexer::keepPosition(int offset)
+{
+	keptPositions[offset] = getPosition(offset);
+}
+
+void Lexer::closeStream()
+{
+	while (!eof)
+		nextBatch();
+	printStreamTokens();
+	inputFile.close();
+
+	if (outputFile.is_open())
+	{
+		if (printed > 0)
+			outputFile << std::endl << std::endl;
+
+		printTablesToFile(outputPath);
+	}
+
+	outputFile.close();
+}
+
+// writes out the batch and lexes the next one, keeping the last token for
+// the position of a parser error on it
+void Lexer::nextBatch()
+{
+	printStreamTokens();
+
+	if (!tokens.empty())
+	{
+		Token last = tokens[tokens.size() - 1];
+		std::pair<int, Position> lastPosition = windowPositions.back();
+
+		tokenBase += tokens.size() - 1;
+		tokens.clear();
+		windowPositions.clear();
+
+		tokens.push_back(last);
+		windowPositions.push_back(lastPosition);
+	}
+
+	lexTokens(tokens.size() + StreamTokens);
+}
+
+void Lexer::lexTokens(size_t limit)
+{
+	Symbol s = lookahead;
 	Token t;
 	std::string tmp;
-	s = gets();
 
-	while (!inputFile.eof())
+	while (!eof && tokens.size() < limit)
 	{
+		keepFrom = sourceBase + pos - 1;
+
 		switch (s.attr)
 		{
 		case SymbolCategories::Whitespace:
-			while (!inputFile.eof())
-			{
-				s = gets();
-				if (s.attr != SymbolCategories::Whitespace)
-					break;
-			}
+			advance(kernels->skipWhitespace, false);
+			s = gets();
 			break;
 
 		case SymbolCategories::Constant:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 
-			while ((!inputFile.eof()) && s.attr == SymbolCategories::Constant)
-			{
-				tmp += s.value;
-				s = gets();
-			}
+			advance(kernels->skipDigits);
+			tmp.assign(source, t.offset - sourceBase, sourceBase + pos - t.offset);
+			s = gets();
 
 			if (constants.find(tmp) == constants.end())
 				setConstant(tmp);
@@ -126,27 +273,25 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 			t.id = constants[tmp];
 			t.value = tmp;
 
-			tokens.push_back(t);
+			if (!streaming)
+				references.record(t.id, (int)tokens.size());
+			addToken(t);
 
 			break;
 
 		case SymbolCategories::Identifier:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 
-			while ((!inputFile.eof()) &&
-				(s.attr == SymbolCategories::Identifier || s.attr == SymbolCategories::Constant))
-			{
-				tmp += s.value;
-				s = gets();
-			}
+			advance(kernels->skipIdentifier);
+			tmp.assign(source, t.offset - sourceBase, sourceBase + pos - t.offset);
+			s = gets();
 
 			t.value = tmp;
 
 			if (keywords.find(tmp) != keywords.end())
 			{
-				t.id = keywords[tmp];
-				tokens.push_back(t);
+				t.id = keywords.at(tmp);
+				addToken(t);
 				break;
 			}
 
@@ -157,28 +302,28 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 
 			t.id = identifiers[tmp];
 
-			tokens.push_back(t);
+			if (!streaming)
+				references.record(t.id, (int)tokens.size());
+			addToken(t);
 
 			break;
 
 		case SymbolCategories::SingleDelimeter:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 			tmp += s.value;
 
 			t.value = tmp;
 
 			t.id = (int)s.value;
 
-			tokens.push_back(t);
+			addToken(t);
 
-			if (!inputFile.eof()) s = gets();
+			if (!eof) s = gets();
 
 			break;
 
 		case SymbolCategories::MultiDelimeterAssembly:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 			tmp += s.value;
 
 			s = gets();
@@ -187,22 +332,21 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 			{
 				tmp += s.value;
 				t.value = tmp;
-				t.id = multipleDelimiters[tmp];
+				t.id = multipleDelimiters.at(tmp);
 
-				tokens.push_back(t);
+				addToken(t);
 			}
 			else
 			{
 				getErrors("expected \")\" after $");
 			}
 
-			if (!inputFile.eof()) s = gets();
+			if (!eof) s = gets();
 
 			break;
 
 		case SymbolCategories::MultiDelimeterEqual:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 			t.id = (int)s.value;
 			tmp += s.value;
 
@@ -211,23 +355,22 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 			if (s.value == '=')
 			{
 				tmp += s.value;
-				t.id = multipleDelimiters[tmp];
+				t.id = multipleDelimiters.at(tmp);
 				t.value = tmp;
-				tokens.push_back(t);
+				addToken(t);
 			}
 			else
 			{
 				t.value = tmp;
-				tokens.push_back(t);
+				addToken(t);
 			}
 
-			if (!inputFile.eof()) s = gets();
+			if (!eof) s = gets();
 
 			break;
 
 		case SymbolCategories::Comment:
-			t.row = row;
-			t.col = col - 1;
+			t.offset = (int)(sourceBase + pos) - 1;
 			tmp += s.value;
 			t.value = tmp;
 			t.id = (int)s.value;
@@ -235,7 +378,7 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 
 			if (s.value == '*')
 			{
-				if (inputFile.eof())
+				if (eof)
 				{
 					getErrors("Expected *), but found the end of file");
 					break;
@@ -244,12 +387,15 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 				s = gets();
 				do
 				{
-					while (s.value != '*' && !inputFile.eof())
+					keepFrom = sourceBase + pos; // the comment is not kept
+
+					while (s.value != '*' && !eof)
 					{
+						advance(kernels->findStar, false);
 						s = gets();
 					}
 
-					if (inputFile.eof())
+					if (eof)
 					{
 						getErrors("expected *), but found the end of file");
 						break;
@@ -258,20 +404,20 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 
 				} while (s.value != ')');
 
-				if (!inputFile.eof()) s = gets();
+				if (!eof) s = gets();
 			}
 			else if (s.value == '$')
 			{
 				tmp += s.value;
 				t.value = tmp;
-				t.id = multipleDelimiters[tmp];
-				tokens.push_back(t);
+				t.id = multipleDelimiters.at(tmp);
+				addToken(t);
 
-				if (!inputFile.eof()) s = gets();
+				if (!eof) s = gets();
 
 				break;
 			}
-			else tokens.push_back(t); // (
+			else addToken(t); // (
 
 			break;
 
@@ -279,7 +425,7 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 			std::string err = "illegal character ";
 			err += s.value;
 			getErrors(err);
-			if (!inputFile.eof()) s = gets();
+			if (!eof) s = gets();
 
 			break;
 		}
@@ -287,7 +433,15 @@ void Lexer::startLexicalAnalyzer(const std::string& filename)
 		tmp = "";
 	}
 
-	inputFile.close();
+	lookahead = s;
+}
+
+void Lexer::addToken(const Token& t)
+{
+	tokens.push_back(t);
+
+	if (streaming)
+		windowPositions.push_back({ t.offset, getPosition(t.offset) });
 }
 
 void Lexer::printLexicalResultsToFile(const std::string& filename)
@@ -303,29 +457,35 @@ void Lexer::printLexicalResultsToFile(const std::string& filename)
 			outputFile << std::endl;
 		}
 
-		if (!constants.empty())
-		{
-			outputFile << "Constants:" << std::endl;
-			printLexemeToFile(constants);
-			outputFile << std::endl;
-		}
+		printTablesToFile(filename);
+	}
 
-		if (!identifiers.empty())
-		{
-			outputFile << "Identifiers:" << std::endl;
-			printLexemeToFile(identifiers);
-			outputFile << std::endl;
-		}
+	outputFile.close();
+}
 
-		for (auto const& i : errors)
-		{
-			outputFile << i << std::endl;
-		}
+// the tables and errors that follow the lexemes
+void Lexer::printTablesToFile(const std::string& filename)
+{
+	if (!constants.empty())
+	{
+		outputFile << "Constants:" << std::endl;
+		printLexemeToFile(constants);
+		outputFile << std::endl;
+	}
 
-		std::cout << "Lexer Results were printed in: \"" << filename << "\"" << std::endl;
+	if (!identifiers.empty())
+	{
+		outputFile << "Identifiers:" << std::endl;
+		printLexemeToFile(identifiers);
+		outputFile << std::endl;
 	}
 
-	outputFile.close();
+	for (auto const& i : errors)
+	{
+		outputFile << i << std::endl;
+	}
+
+	std::cout << "Lexer Results were printed in: \"" << filename << "\"" << std::endl;
 }
 
 void Lexer::printTokensToFile()
@@ -334,13 +494,37 @@ void Lexer::printTokensToFile()
 		<< "Code" << "\t" << "Lexem" << std::endl << std::endl;
 
 	for (auto const& i : tokens) {
-		outputFile << "\t" << i.row << "\t" << i.col << "\t"
+		Position p = getPosition(i.offset);
+		outputFile << "\t" << p.row << "\t" << p.col << "\t"
 			<< i.id << "\t" << i.value << std::endl;
 	}
 
 	outputFile << std::endl;
 }
 
+// the tokens of the batch that are not written yet
+void Lexer::printStreamTokens()
+{
+	if (!outputFile.is_open() || tokenBase + tokens.size() <= printed)
+		return;
+
+	if (printed == 0)
+	{
+		outputFile << "Lexemes:" << std::endl;
+		outputFile << "\t" << "Row" << "\t" << "Col" << "\t"
+			<< "Code" << "\t" << "Lexem" << std::endl << std::endl;
+	}
+
+	for (size_t i = printed - tokenBase; i < tokens.size(); i++)
+	{
+		Position p = windowPositions[i].second;
+		outputFile << "\t" << p.row << "\t" << p.col << "\t"
+			<< tokens[i].id << "\t" << tokens[i].value << std::endl;
+	}
+
+	printed = tokenBase + tokens.size();
+}
+
 void Lexer::printLexemeToFile(const std::unordered_map<std::string, int>& lexeme)
 {
 	outputFile << "\t" << "Code" << "\t" << "Lexem" << std::endl << std::endl;
@@ -402,7 +586,8 @@ void Lexer::printTokensToConsole() const
 		<< "Code" << "\t" << "Lexem" << std::endl << std::endl;
 
 	for (auto const& i : tokens) {
-		std::cout << "\t" << i.row << "\t" << i.col << "\t"
+		Position p = getPosition(i.offset);
+		std::cout << "\t" << p.row << "\t" << p.col << "\t"
 			<< i.id << "\t" << i.value << std::endl;
 	}
 
@@ -435,61 +620,201 @@ void Lexer::printLexemeToConsole(const std::unordered_map<std::string, int>& lex
 	}
 }
 
-void Lexer::handleWhitespace(const Symbol& s)
+Symbol Lexer::gets()
 {
-	if ((int)s.value == 10)
+	Symbol s;
+	if (pos >= source.size() && streaming)
+		refill();
+
+	if (pos < source.size())
 	{
-		row++;
-		col = 1;
+		s.value = source[pos++];
+		s.attr = attributes[(unsigned char)s.value];
 	}
-	else if ((int)s.value == 9)
+	else
 	{
-		col += 3;
+		eof = true;
+		s.value = 0;
+		s.attr = SymbolCategories::Error;
 	}
-	else if ((int)s.value == 32)
+
+	return s;
+}
+
+// keep is false when the skipped bytes are not part of a token
+void Lexer::advance(const char* (*kernel)(const char*, const char*), bool keep)
+{
+	while (true)
 	{
-		col++;
+		const char* begin = source.data();
+		pos = kernel(begin + pos, begin + source.size()) - begin;
+
+		if (pos < source.size() || !streaming)
+			break;
+
+		if (!keep)
+			keepFrom = sourceBase + pos;
+		if (!refill())
+			break;
 	}
 }
 
-Symbol Lexer::gets()
+// drops the input before keepFrom and reads the next block after the rest,
+// false at the end of the file
+bool Lexer::refill()
 {
-	Symbol s;
-	inputFile.get(s.value);
-	if (!inputFile.eof())
+	if (!inputFile.is_open())
+		return false;
+
+	if (keepFrom > sourceBase)
 	{
-		s.attr = attributes[s.value];
-		if (s.attr == SymbolCategories::Whitespace)
-			handleWhitespace(s);
-		else
-			col++;
+		track(keepFrom);
+		source.erase(0, keepFrom - sourceBase);
+		pos -= keepFrom - sourceBase;
+		sourceBase = keepFrom;
 	}
 
-	return s;
+	size_t size = source.size();
+	source.resize(size + StreamBlock);
+	inputFile.read(&source[size], StreamBlock);
+	source.resize(size + (size_t)inputFile.gcount());
+
+	return source.size() > size;
 }
 
-void Lexer::getErrors(const std::string& message)
+// counts the bytes up to the offset into trackedPosition
+void Lexer::track(size_t offset) const
 {
-	std::string err = "Lexer: Error (line ";
-	err += std::to_string(row) + ", column " + std::to_string(col - 1) + "): " + message + "\n";
+	for (; trackedOffset < offset; trackedOffset++)
+	{
+		char c = source[trackedOffset - sourceBase];
+		if (c == '\n')
+		{
+			trackedPosition.row++;
+			trackedPosition.col = 0;
+		}
+		else trackedPosition.col += columnWidth(c);
+	}
+}
 
-	errors.push_back(err);
+void Lexer::setScanLevel(ScanLevel level)
+{
+	kernels = &getScanKernels(level);
 }
 
-void Lexer::setKeyword(const std::string& lex)
+void Lexer::buildLineIndex()
+{
+	const char* begin = source.data();
+	const char* end = begin + source.size();
+
+	// counted first, so the index is allocated once
+	lineStarts.clear();
+	lineStarts.reserve(std::count(begin, end, '\n') + 1);
+	lineStarts.push_back(0);
+	const char* p = begin;
+
+	while ((p = (const char*)std::memchr(p, '\n', end - p)) != nullptr)
+	{
+		p++;
+		lineStarts.push_back((int)(p - begin));
+	}
+
+	cachedOffset = -1;
+}
+
+int Lexer::columnWidth(char c)
+{
+	if (c == '\t')
+		return 3;
+	if (c == ' ')
+		return 1;
+	if (c >= 8 && c <= 13)
+		return 0;
+
+	return 1;
+}
+
+// Row and column of the byte at offset, counted the same way the lexer always
+// reported them: a tab is 3 columns wide and other control whitespace is 0.
+Position Lexer::getPosition(int offset) const
+{
+	if (streaming)
+	{
+		if (offset < 0)
+			return { 1, 0 };
+
+		// the tokens of the batch, then kept ones, then the input still held
+		auto token = std::lower_bound(windowPositions.begin(), windowPositions.end(), offset,
+			[](const std::pair<int, Position>& p, int o) { return p.first < o; });
+		if (token != windowPositions.end() && token->first == offset)
+			return token->second;
+
+		auto kept = keptPositions.find(offset);
+		if (kept != keptPositions.end())
+			return kept->second;
+
+		size_t end = (size_t)offset + 1;
+		if (end < trackedOffset || end > sourceBase + source.size())
+			return { 1, 0 }; // dropped with its batch
+
+		track(end);
+		return trackedPosition;
+	}
+
+	if (offset < 0 || lineStarts.empty())
+		return { 1, 0 }; // nothing read yet
+
+	int end = offset + 1;
+	int from;
+	Position p;
+
+	bool sameLine = cachedPosition.row == (int)lineStarts.size() || end < lineStarts[cachedPosition.row];
+
+	if (cachedOffset >= 0 && cachedOffset < end && sameLine)
+	{
+		p = cachedPosition;
+		from = cachedOffset + 1;
+	}
+	else
+	{
+		p.row = (int)(std::upper_bound(lineStarts.begin(), lineStarts.end(), end) - lineStarts.begin());
+		p.col = 0;
+		from = lineStarts[p.row - 1];
+	}
+
+	for (int i = from; i < end; i++)
+		p.col += columnWidth(source[i]);
+
+	cachedOffset = offset;
+	cachedPosition = p;
+
+	return p;
+}
+
+void Lexer::getErrors(const std::string& message)
 {
-	size_t keywordId = 401 + keywords.size();
-	keywords.insert({ lex, keywordId });
+	Position p = getPosition((int)(sourceBase + pos) - 1);
+
+	std::string& err = errors.append();
+	err = "Lexer: Error (line ";
+	err += std::to_string(p.row);
+	err += ", column ";
+	err += std::to_string(p.col);
+	err += "): ";
+	err += message;
+	err += "\n";
 }
 
 void Lexer::setConstant(const std::string& lex)
 {
 	size_t constantId = 501 + constants.size();
 	constants.insert({ lex, constantId });
+	constantsById.push_back(lex);
 }
 
 void Lexer::setIdentifier(const std::string& lex)
 {
 	size_t identifierId = 1001 + identifiers.size();
 	identifiers.insert({ lex, identifierId });
+	identifiersById.push_back(lex);
 }
@@ -1,12 +1,15 @@
 #pragma once
 
+#include "scan.h"
+#include "storage.h"
+#include "xref.h"
+
 #include <string>
 #include <fstream>
 #include <queue>
 #include <vector>
 #include <array>
 #include <unordered_map>
-#include <list>
 
 enum class SymbolCategories
 {
@@ -28,33 +31,83 @@ struct Symbol
 
 struct Token
 {
-	int row = 0;
-	int col = 0;
+	int offset = 0; // byte offset in the source, see Lexer::getPosition()
 	int id = 0;
 	std::string value = "";
 };
 
+// program text passed to the parser directly instead of a file name
+struct SourceText
+{
+	std::string text;
+};
+
+struct Position
+{
+	int row = 0;
+	int col = 0;
+};
+
 class Lexer
 {
 public:
-	std::unordered_map<std::string, int> singleDelimiters;
-	std::unordered_map<std::string, int> multipleDelimiters;
-	std::unordered_map<std::string, int> keywords;
+	// the same for every lexer, built once
+	static const std::unordered_map<std::string, int> singleDelimiters;
+	static const std::unordered_map<std::string, int> multipleDelimiters;
+	static const std::unordered_map<std::string, int> keywords;
+
 	std::unordered_map<std::string, int> constants;
 	std::unordered_map<std::string, int> identifiers;
 
-	std::vector<Token> tokens;
-	std::list<std::string> errors;
+	// lexemes in id order, for reverse lookups
+	std::vector<std::string> constantsById;
+	std::vector<std::string> identifiersById;
+
+	// pooled, so a batch run reuses the storage of finished files
+	ChunkedList<Token> tokens;
+	ChunkedList<std::string, 256> errors;
+
+	// definitions and uses of every constant and identifier, by id
+	CrossReference references;
 
 private:
 	std::ifstream inputFile;
 	std::ofstream outputFile;
 
-	std::array<SymbolCategories, 255> attributes;
+	std::array<SymbolCategories, 256> attributes;
 	SymbolCategories category;
 
-	int row;
-	int col;
+	const ScanKernels* kernels;
+
+	std::string source;
+	size_t pos;
+	bool eof;
+
+	// offsets of the first byte of every line
+	std::vector<int> lineStarts;
+
+	// last computed position, so that sequential lookups don't rescan the line
+	mutable int cachedOffset;
+	mutable Position cachedPosition;
+
+	// streaming, see openStream(): source holds the input from sourceBase on
+	// and tokens the program's tokens from tokenBase on
+	bool streaming = false;
+	size_t sourceBase = 0;
+	size_t keepFrom = 0; // input offset the next block keeps the bytes from
+	size_t tokenBase = 0;
+	size_t printed = 0; // tokens written to the lexer output
+	std::string outputPath = "";
+	Symbol lookahead = { 0, SymbolCategories::Error };
+	std::vector<std::pair<int, Position>> windowPositions; // offset and position of the tokens
+	std::unordered_map<int, Position> keptPositions;
+
+	// the bytes before trackedOffset are counted into trackedPosition
+	mutable size_t trackedOffset = 0;
+	mutable Position trackedPosition = { 1, 0 };
+
+	static const size_t StreamBlock = 1 << 16;
+	static const size_t StreamTokens = 4096;
 
 public:
 	Lexer();
@@ -63,21 +116,49 @@ public:
 
 	//void openFile(const std::string&);
 	void startLexicalAnalyzer(const std::string& filename);
+	// the same for source text that is not in a file
+	void analyzeSource(std::string);
+
+	// Streaming: the file is read in blocks of 64 KB and lexed a batch of
+	// tokens at a time as the parser asks for them, so only the current block
+	// and batch are in memory. Tokens are written to the output when their
+	// batch is dropped, positions are counted as the input goes by, cross
+	// references are not recorded.
+	void openStream(const std::string&, const std::string&);
+	// the token at the index in the program, nullptr after the last one
+	const Token* streamToken(size_t);
+	// the position of a token stays known after its batch is dropped
+	void keepPosition(int);
+	// lexes the rest and finishes the output
+	void closeStream();
 
 	void printLexicalResultsToFile(const std::string&);
 	void printLexicalResultsToConsole() const; 
 
+	Position getPosition(int) const;
+
+	void setScanLevel(ScanLevel);
+
 private:
 	void initializeTables();
+	void analyze();
+	void lexTokens(size_t);
+	void addToken(const Token&);
+	void buildLineIndex();
 	Symbol gets();
+	void advance(const char* (*)(const char*, const char*), bool = true);
+	bool refill();
+	void track(size_t) const;
+	void nextBatch();
 
-	void handleWhitespace(const Symbol&);
+	static int columnWidth(char);
 	void getErrors(const std::string&);
 	void setConstant(const std::string&);
-	void setKeyword(const std::string&);
 	void setIdentifier(const std::string&);
 
 	void printTokensToFile();
+	void printStreamTokens();
+	void printTablesToFile(const std::string&);
 	void printLexemeToFile(const std::unordered_map<std::string, int>&);
 
 	void printTokensToConsole() const;
@@ -0,0 +1,276 @@
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define TARGET_AVX2
+#define TARGET_SSE2
+#endif
+
+static bool isWhitespace(char c)
+{
+	return c == ' ' || (c >= 8 && c <= 13);
+}
+
+static bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool isLetterOrDigit(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || isDigit(c);
+}
+
+static const char* skipWhitespaceScalar(const char* p, const char* end)
+{
+	while (p < end && isWhitespace(*p))
+		p++;
+	return p;
+}
+
+static const char* skipIdentifierScalar(const char* p, const char* end)
+{
+	while (p < end && isLetterOrDigit(*p))
+		p++;
+	return p;
+}
+
+static const char* skipDigitsScalar(const char* p, const char* end)
+{
+	while (p < end && isDigit(*p))
+		p++;
+	return p;
+}
+
+static const char* findStarScalar(const char* p, const char* end)
+{
+	while (p < end && *p != '*')
+		p++;
+	return p;
+}
+
+#ifdef SCAN_X86
+
+static int firstSet(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// All comparisons are signed, so bytes >= 0x80 (negative) fall outside every range.
+
+TARGET_SSE2 static __m128i inRange16(__m128i v, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+TARGET_SSE2 static const char* skipWhitespaceSSE2(const char* p, const char* end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i match = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange16(v, 8, 13));
+
+		unsigned mask = ~(unsigned)_mm_movemask_epi8(match) & 0xFFFF;
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipWhitespaceScalar(p, end);
+}
+
+TARGET_SSE2 static const char* skipIdentifierSSE2(const char* p, const char* end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20)); // A..Z -> a..z, nothing else lands there
+		__m128i match = _mm_or_si128(inRange16(lower, 'a', 'z'), inRange16(v, '0', '9'));
+
+		unsigned mask = ~(unsigned)_mm_movemask_epi8(match) & 0xFFFF;
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipIdentifierScalar(p, end);
+}
+
+TARGET_SSE2 static const char* skipDigitsSSE2(const char* p, const char* end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+
+		unsigned mask = ~(unsigned)_mm_movemask_epi8(inRange16(v, '0', '9')) & 0xFFFF;
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipDigitsScalar(p, end);
+}
+
+TARGET_SSE2 static const char* findStarSSE2(const char* p, const char* end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return findStarScalar(p, end);
+}
+
+TARGET_AVX2 static __m256i inRange32(__m256i v, char lo, char hi)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+TARGET_AVX2 static const char* skipWhitespaceAVX2(const char* p, const char* end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange32(v, 8, 13));
+
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(match);
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipWhitespaceSSE2(p, end);
+}
+
+TARGET_AVX2 static const char* skipIdentifierAVX2(const char* p, const char* end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		__m256i match = _mm256_or_si256(inRange32(lower, 'a', 'z'), inRange32(v, '0', '9'));
+
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(match);
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipIdentifierSSE2(p, end);
+}
+
+TARGET_AVX2 static const char* skipDigitsAVX2(const char* p, const char* end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(inRange32(v, '0', '9'));
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return skipDigitsSSE2(p, end);
+}
+
+TARGET_AVX2 static const char* findStarAVX2(const char* p, const char* end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+		if (mask != 0)
+			return p + firstSet(mask);
+	}
+
+	return findStarSSE2(p, end);
+}
+
+static bool cpuHasSSE2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // OS saves the ymm registers
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const ScanKernels scalarKernels = {
+	ScanLevel::Scalar, "scalar",
+	skipWhitespaceScalar, skipIdentifierScalar, skipDigitsScalar, findStarScalar
+};
+
+#ifdef SCAN_X86
+static const ScanKernels sse2Kernels = {
+	ScanLevel::SSE2, "sse2",
+	skipWhitespaceSSE2, skipIdentifierSSE2, skipDigitsSSE2, findStarSSE2
+};
+
+static const ScanKernels avx2Kernels = {
+	ScanLevel::AVX2, "avx2",
+	skipWhitespaceAVX2, skipIdentifierAVX2, skipDigitsAVX2, findStarAVX2
+};
+#endif
+
+const ScanKernels& getScanKernels(ScanLevel level)
+{
+#ifdef SCAN_X86
+	static const bool hasSSE2 = cpuHasSSE2();
+	static const bool hasAVX2 = hasSSE2 && cpuHasAVX2();
+
+	if (level >= ScanLevel::AVX2 && hasAVX2)
+		return avx2Kernels;
+	if (level >= ScanLevel::SSE2 && hasSSE2)
+		return sse2Kernels;
+#endif
+
+	return scalarKernels;
+}
+
+const ScanKernels& getScanKernels()
+{
+	return getScanKernels(ScanLevel::AVX2);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// Bulk scanning kernels used by the lexer. Every kernel takes [p, end) and
+// returns the first byte that does not belong to the run (or end).
+// Bytes >= 0x80 never belong to a run, so the lexer reports them as errors.
+
+enum class ScanLevel
+{
+	Scalar = 0,
+	SSE2 = 1,
+	AVX2 = 2
+};
+
+struct ScanKernels
+{
+	ScanLevel level;
+	const char* name;
+
+	const char* (*skipWhitespace)(const char*, const char*); // ' ' and 8..13
+	const char* (*skipIdentifier)(const char*, const char*); // A..Z a..z 0..9
+	const char* (*skipDigits)(const char*, const char*); // 0..9
+	const char* (*findStar)(const char*, const char*); // next '*' inside a comment
+};
+
+// best kernels supported by the running CPU
+const ScanKernels& getScanKernels();
+
+// kernels of the given level, or the best supported one below it
+const ScanKernels& getScanKernels(ScanLevel);
@@ -0,0 +1,89 @@
+#include "storage.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// The replaceable allocation functions, counting every allocation of the
+// process for heapAllocations(). The other forms (nothrow, arrays) call these.
+// Only a build for --bench-storage defines COUNT_ALLOCATIONS, the normal one
+// keeps the library's allocator.
+
+static std::atomic<size_t> allocations{ 0 };
+
+size_t heapAllocations()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+// the handler may free memory for another try, without one there is none
+static void outOfMemory()
+{
+	std::new_handler handler = std::get_new_handler();
+	if (handler == nullptr)
+		throw std::bad_alloc();
+
+	handler();
+}
+
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* p;
+	while ((p = std::malloc(size != 0 ? size : 1)) == nullptr)
+		outOfMemory();
+
+	return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	// aligned_alloc wants a multiple of the alignment
+	size_t a = (size_t)alignment;
+	size = (size + a - 1) / a * a;
+
+	void* p;
+#ifdef _WIN32
+	while ((p = _aligned_malloc(size != 0 ? size : a, a)) == nullptr)
+#else
+	while ((p = std::aligned_alloc(a, size != 0 ? size : a)) == nullptr)
+#endif
+		outOfMemory();
+
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept
+{
+	operator delete(p, alignment);
+}
+
+#endif
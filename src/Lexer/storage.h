@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef COUNT_ALLOCATIONS
+// operator new calls of the whole process so far, see storage.cpp
+size_t heapAllocations();
+#endif
+
+// Fixed-size chunks of elements shared by all compilation units of a run.
+// Released chunks keep their elements constructed, so strings in a reused
+// chunk keep their capacity and refilling it allocates nothing.
+template <typename T, size_t ChunkSize>
+class ChunkPool
+{
+public:
+	struct Chunk
+	{
+		T items[ChunkSize];
+	};
+
+private:
+	std::mutex lock;
+	std::vector<std::unique_ptr<Chunk>> chunks; // every chunk ever allocated
+	std::vector<Chunk*> free;
+	std::vector<std::vector<Chunk*>> directories; // chunk lists of finished users
+
+public:
+	static ChunkPool& shared()
+	{
+		static ChunkPool pool;
+		return pool;
+	}
+
+	Chunk* acquire()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (free.empty())
+		{
+			chunks.push_back(std::make_unique<Chunk>());
+			return chunks.back().get();
+		}
+
+		Chunk* c = free.back();
+		free.pop_back();
+		return c;
+	}
+
+	std::vector<Chunk*> acquireDirectory()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (directories.empty())
+			return {};
+
+		std::vector<Chunk*> d = std::move(directories.back());
+		directories.pop_back();
+		return d;
+	}
+
+	// gives back the chunks and the list that held them
+	void release(std::vector<Chunk*>& directory)
+	{
+		if (directory.capacity() == 0)
+			return;
+
+		std::lock_guard<std::mutex> guard(lock);
+		free.insert(free.end(), directory.begin(), directory.end());
+		directory.clear();
+		directories.push_back(std::move(directory));
+	}
+
+	size_t allocatedChunks()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return chunks.size();
+	}
+};
+
+// Append-only sequence stored in pooled chunks. Growing never moves
+// elements, and a finished list returns its chunks for the next file.
+template <typename T, size_t ChunkSize = 4096>
+class ChunkedList
+{
+public:
+	using Pool = ChunkPool<T, ChunkSize>;
+
+	class const_iterator
+	{
+	private:
+		const ChunkedList* list;
+		size_t index;
+
+	public:
+		const_iterator(const ChunkedList* l, size_t i) : list(l), index(i) {}
+
+		const T& operator*() const { return (*list)[index]; }
+		const T* operator->() const { return &(*list)[index]; }
+		const_iterator& operator++() { index++; return *this; }
+		bool operator!=(const const_iterator& other) const { return index != other.index; }
+		bool operator==(const const_iterator& other) const { return index == other.index; }
+	};
+
+private:
+	std::vector<typename Pool::Chunk*> chunks;
+	size_t count = 0;
+
+public:
+	ChunkedList() = default;
+	ChunkedList(const ChunkedList&) = delete;
+	ChunkedList& operator=(const ChunkedList&) = delete;
+
+	~ChunkedList()
+	{
+		Pool::shared().release(chunks);
+	}
+
+	// next element, holding whatever a previous file left in it
+	T& append()
+	{
+		if (count == chunks.size() * ChunkSize)
+		{
+			if (chunks.capacity() == 0)
+				chunks = Pool::shared().acquireDirectory();
+			chunks.push_back(Pool::shared().acquire());
+		}
+
+		T& item = chunks[count / ChunkSize]->items[count % ChunkSize];
+		count++;
+		return item;
+	}
+
+	void push_back(const T& item)
+	{
+		append() = item;
+	}
+
+	// keeps the chunks for the next use of this list
+	void clear()
+	{
+		count = 0;
+	}
+
+	T& operator[](size_t i) { return chunks[i / ChunkSize]->items[i % ChunkSize]; }
+	const T& operator[](size_t i) const { return chunks[i / ChunkSize]->items[i % ChunkSize]; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, count); }
+};
@@ -0,0 +1,200 @@
+#include "xref.h"
+#include "lexer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+
+static size_t encodedSize(uint32_t value)
+{
+	size_t n = 1;
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		n++;
+	}
+
+	return n;
+}
+
+static uint8_t* encode(uint8_t* out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+
+	return out;
+}
+
+void CrossReference::clear()
+{
+	recorded.clear();
+	constantSlots = 0;
+
+	for (int k = 0; k < 2; k++)
+	{
+		starts[k].clear();
+		counts[k].clear();
+		bytes[k].clear();
+	}
+}
+
+void CrossReference::build(const ChunkedList<Token>& tokens)
+{
+	size_t identifierSlots = 0;
+	constantSlots = 0;
+	for (auto const& r : recorded)
+	{
+		if (r.first < FirstIdentifier)
+			constantSlots = std::max(constantSlots, (size_t)(r.first - FirstConstant + 1));
+		else
+			identifierSlots = std::max(identifierSlots, (size_t)(r.first - FirstIdentifier + 1));
+	}
+
+	auto slotOf = [&](int id)
+	{
+		return id < FirstIdentifier ? (size_t)(id - FirstConstant) : constantSlots + (size_t)(id - FirstIdentifier);
+	};
+
+	size_t slots = constantSlots + identifierSlots;
+
+	std::vector<uint8_t> kinds(recorded.size());
+	std::vector<int> last[2];
+
+	// sizes of the lists first, so every list is written in place
+	for (int k = 0; k < 2; k++)
+	{
+		starts[k].assign(slots + 1, 0);
+		counts[k].assign(slots, 0);
+		last[k].assign(slots, 0);
+	}
+
+	for (size_t i = 0; i < recorded.size(); i++)
+	{
+		int id = recorded[i].first;
+		int token = recorded[i].second;
+
+		int before = token > 0 ? tokens[token - 1].id : 0;
+		int after = token + 1 < (int)tokens.size() ? tokens[token + 1].id : 0;
+
+		bool definition;
+		if (id < FirstIdentifier)
+			definition = after == 58; // label:
+		else
+			definition = before == 401 || before == 405 || after == 303; // PROGRAM, LINK, :=
+
+		int k = definition ? Definition : Use;
+		size_t slot = slotOf(id);
+
+		kinds[i] = (uint8_t)k;
+		counts[k][slot]++;
+		starts[k][slot + 1] += (uint32_t)encodedSize((uint32_t)(token - last[k][slot]));
+		last[k][slot] = token;
+	}
+
+	std::vector<uint32_t> end[2];
+	for (int k = 0; k < 2; k++)
+	{
+		for (size_t s = 0; s < slots; s++)
+			starts[k][s + 1] += starts[k][s];
+
+		bytes[k].resize(starts[k][slots]);
+		end[k].assign(starts[k].begin(), starts[k].end() - 1);
+		std::fill(last[k].begin(), last[k].end(), 0);
+	}
+
+	for (size_t i = 0; i < recorded.size(); i++)
+	{
+		int k = kinds[i];
+		size_t slot = slotOf(recorded[i].first);
+		int token = recorded[i].second;
+
+		uint8_t* out = bytes[k].data() + end[k][slot];
+		end[k][slot] = (uint32_t)(encode(out, (uint32_t)(token - last[k][slot])) - bytes[k].data());
+		last[k][slot] = token;
+	}
+
+	recorded.clear();
+}
+
+CrossReference::Occurrences CrossReference::find(int id, Kind kind) const
+{
+	size_t slot;
+	if (id >= FirstConstant && id < FirstIdentifier && (size_t)(id - FirstConstant) < constantSlots)
+		slot = (size_t)(id - FirstConstant);
+	else if (id >= FirstIdentifier && constantSlots + (size_t)(id - FirstIdentifier) < counts[kind].size())
+		slot = constantSlots + (size_t)(id - FirstIdentifier);
+	else
+		return Occurrences(nullptr, 0);
+
+	return Occurrences(bytes[kind].data() + starts[kind][slot], counts[kind][slot]);
+}
+
+size_t CrossReference::occurrenceCount() const
+{
+	size_t n = 0;
+	for (int k = 0; k < 2; k++)
+	{
+		for (uint32_t c : counts[k])
+			n += c;
+	}
+
+	return n;
+}
+
+size_t CrossReference::byteSize() const
+{
+	size_t n = 0;
+	for (int k = 0; k < 2; k++)
+		n += bytes[k].size() + (starts[k].size() + counts[k].size()) * sizeof(uint32_t);
+
+	return n;
+}
+
+bool findReferences(const std::string& name, const std::vector<std::string>& files)
+{
+	size_t found = 0;
+	double lexing = 0;
+	double querying = 0;
+
+	for (auto const& filename : files)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		Lexer lexer;
+		lexer.startLexicalAnalyzer(filename);
+
+		auto lexed = std::chrono::steady_clock::now();
+
+		auto constant = lexer.constants.find(name);
+		auto identifier = lexer.identifiers.find(name);
+		int id = constant != lexer.constants.end() ? constant->second :
+			identifier != lexer.identifiers.end() ? identifier->second : 0;
+
+		for (int k = 0; k < 2; k++)
+		{
+			for (int token : lexer.references.find(id, (CrossReference::Kind)k))
+			{
+				Position p = lexer.getPosition(lexer.tokens[token].offset);
+				std::cout << "Xref: " << filename << " (Line " << p.row << ", Column " << p.col << "): "
+					<< (k == CrossReference::Definition ? "definition" : "use") << " of " << name << std::endl;
+				found++;
+			}
+		}
+
+		std::chrono::duration<double> lexTime = lexed - start;
+		std::chrono::duration<double> queryTime = std::chrono::steady_clock::now() - lexed;
+		lexing += lexTime.count();
+		querying += queryTime.count();
+	}
+
+	double total = lexing + querying;
+	std::cout << "Xref: " << files.size() << " files, " << found << " occurrences of " << name << ", lexing "
+		<< lexing * 1000 << " ms, queries " << querying * 1000 << " ms, "
+		<< (total > 0 ? files.size() / total : 0) << " files/s" << std::endl;
+
+	return found > 0;
+}
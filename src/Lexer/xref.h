@@ -0,0 +1,115 @@
+#pragma once
+
+#include "storage.h"
+
+#include <cstddef>
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+struct Token;
+
+// Token indexes of every constant and identifier, by id. The lexer records
+// each occurrence as it assigns the id, build() sorts them into definitions
+// and uses: the PROGRAM name, a LINK variable, the target of := and a label
+// before ':' are definitions, everything else is a use. Each list is stored
+// as LEB128 deltas of increasing token indexes in one byte array per kind,
+// so finding a list is two array reads and reading it decodes only its bytes.
+class CrossReference
+{
+public:
+	enum Kind
+	{
+		Definition = 0,
+		Use = 1
+	};
+
+	// token indexes of one id, decoded while iterating
+	class Occurrences
+	{
+	public:
+		class iterator
+		{
+		private:
+			const uint8_t* next;
+			size_t left; // occurrences from the current one on
+			int token;
+
+		public:
+			iterator(const uint8_t* p, size_t n) : next(p), left(n), token(0)
+			{
+				if (left > 0)
+					decode();
+			}
+
+			int operator*() const { return token; }
+			bool operator!=(const iterator& other) const { return left != other.left; }
+
+			iterator& operator++()
+			{
+				if (--left > 0)
+					decode();
+				return *this;
+			}
+
+		private:
+			void decode()
+			{
+				uint32_t delta = 0;
+				int shift = 0;
+				while (*next & 0x80)
+				{
+					delta |= (uint32_t)(*next++ & 0x7f) << shift;
+					shift += 7;
+				}
+				delta |= (uint32_t)*next++ << shift;
+
+				token += (int)delta;
+			}
+		};
+
+	private:
+		const uint8_t* bytes;
+		size_t count;
+
+	public:
+		Occurrences(const uint8_t* p, size_t n) : bytes(p), count(n) {}
+
+		iterator begin() const { return iterator(bytes, count); }
+		iterator end() const { return iterator(nullptr, 0); }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+	};
+
+private:
+	static const int FirstConstant = 501;
+	static const int FirstIdentifier = 1001;
+
+	std::vector<std::pair<int, int>> recorded; // id, token index in lexing order
+
+	// by slot, the constants and then the identifiers: where the list starts
+	// in bytes[kind] (one more for the end of the last list) and its length
+	size_t constantSlots = 0;
+	std::vector<uint32_t> starts[2];
+	std::vector<uint32_t> counts[2];
+	std::vector<uint8_t> bytes[2];
+
+public:
+	void clear();
+	void record(int id, int token) { recorded.emplace_back(id, token); }
+
+	// classifies by the neighbouring tokens and encodes the lists
+	void build(const ChunkedList<Token>&);
+
+	Occurrences find(int, Kind) const;
+	Occurrences definitions(int id) const { return find(id, Definition); }
+	Occurrences uses(int id) const { return find(id, Use); }
+
+	size_t occurrenceCount() const;
+	size_t byteSize() const;
+};
+
+// Prints the definitions and uses of a name in every file with their
+// positions, then the time spent lexing and querying
+bool findReferences(const std::string&, const std::vector<std::string>&);
@@ -0,0 +1,225 @@
+#include "linker.h"
+#include "../Parser/parser.h"
+
+#include <thread>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+
+int SymbolTable::intern(const std::string& name)
+{
+	Shard& shard = shards[std::hash<std::string>()(name) % ShardCount];
+	std::lock_guard<std::mutex> guard(shard.lock);
+
+	auto i = shard.ids.find(name);
+	if (i != shard.ids.end())
+		return i->second;
+
+	int id = nextId++;
+	shard.ids.emplace(name, id);
+	return id;
+}
+
+std::vector<std::string> SymbolTable::names()
+{
+	std::vector<std::string> result(size());
+	for (auto& shard : shards)
+	{
+		for (auto const& i : shard.ids)
+			result[i.second] = i.first;
+	}
+
+	return result;
+}
+
+Linker::Linker(unsigned int threadLimit) : threads(threadLimit)
+{
+	if (threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+}
+
+void Linker::addProgram(const std::string& filename)
+{
+	LinkedProgram program;
+	program.filename = filename;
+	programs.push_back(std::move(program));
+}
+
+bool Linker::link()
+{
+	errors.clear();
+
+	// every worker parses whole programs and only meets the others in the symbol table
+	std::atomic<size_t> next{ 0 };
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < programs.size(); i = next++)
+			collect(programs[i]);
+	};
+
+	size_t count = std::min<size_t>(threads, programs.size());
+	std::vector<std::thread> pool;
+	for (size_t i = 1; i < count; i++)
+		pool.emplace_back(worker);
+	worker();
+
+	for (auto& t : pool)
+		t.join();
+
+	resolve();
+	return errors.empty();
+}
+
+// first token below a node, nullptr for "<empty>" and incomplete nodes
+static const Node* firstToken(const Node* n)
+{
+	while (n->offset < 0)
+	{
+		if (n->leaf.empty())
+			return nullptr;
+		n = n->leaf[0].get();
+	}
+
+	return n;
+}
+
+void Linker::collect(LinkedProgram& program)
+{
+	Parser par(program.filename, "", "");
+	par.startParsing();
+
+	bool failed = par.hasErrors();
+	if (failed)
+	{
+		std::ostringstream out;
+		par.printErrors(out);
+
+		std::istringstream lines(out.str());
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			if (!line.empty())
+				program.diagnostics.push_back(line);
+		}
+	}
+
+	// lexer ids are local to the program, they are interned once each
+	std::vector<int> globalIds;
+	auto reference = [&](const Node* n)
+	{
+		SymbolReference r;
+		n = firstToken(n);
+		if (n == nullptr)
+			return r;
+
+		size_t local = (size_t)(n->id - 1001);
+		if (local >= globalIds.size())
+			globalIds.resize(local + 1, -1);
+		if (globalIds[local] < 0)
+			globalIds[local] = symbols.intern(n->value);
+
+		r.symbol = globalIds[local];
+		r.position = par.getPosition(n->offset);
+		return r;
+	};
+
+	std::vector<const Node*> pending = { par.getTree() };
+	while (!pending.empty())
+	{
+		const Node* n = pending.back();
+		pending.pop_back();
+
+		if (n->value == "<program>")
+		{
+			if (n->leaf.size() > 1)
+				program.procedure = reference(n->leaf[1].get());
+			if (n->leaf.size() > 3 && !failed)
+				pending.push_back(n->leaf[3].get());
+			continue;
+		}
+
+		if (n->value == "<statement>" && !n->leaf.empty() && n->leaf[0]->id == 405)
+		{
+			if (n->leaf.size() > 1)
+				program.links.push_back(reference(n->leaf[1].get()));
+			continue;
+		}
+
+		if (n->value == "<procedure-identifier>")
+			program.calls.push_back(reference(n));
+		else if (n->value == "<variable-identifier>")
+			program.uses.push_back(reference(n));
+		else
+		{
+			for (auto i = n->leaf.rbegin(); i != n->leaf.rend(); ++i)
+				pending.push_back(i->get());
+		}
+	}
+
+	// a program with errors still defines its procedure when the header parsed,
+	// so that its callers don't fail too
+	program.parsed = !failed;
+}
+
+void Linker::resolve()
+{
+	std::vector<int> definedBy(symbols.size(), -1);
+	std::vector<bool> linked(symbols.size(), false);
+	std::vector<std::string> names = symbols.names();
+
+	for (size_t i = 0; i < programs.size(); i++)
+	{
+		LinkedProgram const& program = programs[i];
+		if (!program.parsed)
+		{
+			// the program's own diagnostics, with its file name
+			for (auto const& d : program.diagnostics)
+			{
+				size_t at = d.find("Error (");
+				if (at == std::string::npos)
+					errors.push_back("Linker: Error (" + program.filename + "): " + d);
+				else
+					errors.push_back(d.substr(0, at + 7) + program.filename + ", " + d.substr(at + 7));
+			}
+		}
+
+		for (auto const& r : program.links)
+		{
+			if (r.symbol >= 0)
+				linked[r.symbol] = true;
+		}
+
+		int symbol = program.procedure.symbol;
+		if (symbol < 0)
+			continue;
+
+		if (definedBy[symbol] >= 0)
+			showError(program, program.procedure.position, "procedure '" + names[symbol]
+				+ "' is already defined in " + programs[definedBy[symbol]].filename);
+		else
+			definedBy[symbol] = (int)i;
+	}
+
+	for (auto const& program : programs)
+	{
+		for (auto const& r : program.calls)
+		{
+			if (r.symbol >= 0 && definedBy[r.symbol] < 0)
+				showError(program, r.position, "unresolved procedure '" + names[r.symbol] + "'");
+		}
+
+		for (auto const& r : program.uses)
+		{
+			if (r.symbol >= 0 && !linked[r.symbol])
+				showError(program, r.position, "unresolved variable '" + names[r.symbol] + "'");
+		}
+	}
+}
+
+void Linker::showError(const LinkedProgram& program, const Position& p, const std::string& err)
+{
+	errors.push_back("Linker: Error (" + program.filename + ", Line " + std::to_string(p.row)
+		+ ", Column " + std::to_string(p.col) + "): " + err + ".");
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../Lexer/lexer.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+// Program-wide names. Worker threads intern identifiers concurrently, every
+// shard has its own lock so threads rarely wait for each other.
+class SymbolTable
+{
+private:
+	struct Shard
+	{
+		std::mutex lock;
+		std::unordered_map<std::string, int> ids;
+	};
+
+	static const size_t ShardCount = 64;
+
+	std::array<Shard, ShardCount> shards;
+	std::atomic<int> nextId{ 0 };
+
+public:
+	int intern(const std::string&);
+
+	size_t size() const { return (size_t)nextId.load(); }
+
+	// names in id order, only valid when no thread is interning
+	std::vector<std::string> names();
+};
+
+struct SymbolReference
+{
+	int symbol = -1; // global id
+	Position position;
+};
+
+// References of one program, in global ids
+struct LinkedProgram
+{
+	std::string filename = "";
+	bool parsed = false;
+	std::vector<std::string> diagnostics; // lexer and parser errors when it didn't parse
+
+	SymbolReference procedure; // PROGRAM <procedure-identifier>
+	std::vector<SymbolReference> calls;
+	std::vector<SymbolReference> links; // LINK <variable-identifier>, ...
+	std::vector<SymbolReference> uses; // assignments and actual arguments
+};
+
+// Links many programs: every PROGRAM defines a procedure that the others can
+// call, every LINK makes a variable known to all of them.
+class Linker
+{
+private:
+	std::vector<LinkedProgram> programs;
+	SymbolTable symbols;
+	unsigned int threads;
+
+	std::list<std::string> errors;
+
+public:
+	Linker(unsigned int = 0);
+
+	void addProgram(const std::string&);
+
+	// false when a program doesn't parse or a reference stays unresolved
+	bool link();
+
+	const std::list<std::string>& getErrors() const { return errors; }
+	size_t programCount() const { return programs.size(); }
+	size_t symbolCount() const { return symbols.size(); }
+	unsigned int threadCount() const { return threads; }
+
+private:
+	void collect(LinkedProgram&);
+	void resolve();
+
+	void showError(const LinkedProgram&, const Position&, const std::string&);
+};
@@ -0,0 +1,517 @@
+#include "loader.h"
+#include "../Lexer/lexer.h"
+#include "../Parser/parser.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#endif
+
+FileLoader::FileLoader(const std::vector<std::string>& f, LoadMethod m, unsigned int t, unsigned int b) :
+	files(f), method(m), threads(t), batch(std::max(1u, b))
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = (unsigned int)std::max<size_t>(1, std::min<size_t>(threads, files.size()));
+
+	if (method == LoadMethod::Uring)
+	{
+#ifdef __linux__
+		static const int opcodes[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+
+		// three entries per file of a batch, the statx ones are reaped before
+		uring = std::make_unique<IoUring>();
+		if (!uring->open(batch * 4) || !uring->supports(opcodes, 4) || !uring->registerFiles(batch))
+			uring.reset();
+#endif
+		if (!uring)
+			method = LoadMethod::Pread;
+	}
+
+	if (method == LoadMethod::Uring)
+	{
+		readers.emplace_back([this]()
+		{
+			// direct descriptors in openat came after the other opcodes
+			if (!readRing())
+				readPositional();
+		});
+	}
+	else
+	{
+		for (unsigned int i = 0; i < threads; i++)
+			readers.emplace_back([this]() { readPositional(); });
+	}
+}
+
+FileLoader::~FileLoader()
+{
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		stopping = true;
+	}
+	room.notify_all();
+
+	for (auto& reader : readers)
+		reader.join();
+}
+
+bool FileLoader::next(LoadedFile& file)
+{
+	std::unique_lock<std::mutex> hold(lock);
+	if (taken == files.size())
+		return false;
+
+	ready.wait(hold, [this]() { return !done.empty(); });
+	file = std::move(done.front());
+	done.pop_front();
+	taken++;
+
+	hold.unlock();
+	room.notify_one();
+	return true;
+}
+
+size_t FileLoader::systemCalls() const
+{
+	return calls + (uring ? uring->systemCalls() : 0);
+}
+
+void FileLoader::queue(LoadedFile&& file)
+{
+	std::unique_lock<std::mutex> hold(lock);
+	room.wait(hold, [this]() { return done.size() < maxQueued || stopping; });
+	if (stopping)
+		return;
+
+	done.push_back(std::move(file));
+	hold.unlock();
+	ready.notify_one();
+}
+
+void FileLoader::readPositional()
+{
+	while (true)
+	{
+		size_t index = nextFile++;
+		if (index >= files.size())
+			return;
+
+		LoadedFile file;
+		file.index = index;
+		file.filename = files[index];
+
+#ifdef __linux__
+		int descriptor = ::open(file.filename.c_str(), O_RDONLY | O_CLOEXEC);
+		calls++;
+		if (descriptor >= 0)
+		{
+			struct stat status;
+			calls++;
+			if (fstat(descriptor, &status) == 0)
+			{
+				file.text.resize((size_t)status.st_size);
+
+				size_t got = 0;
+				ssize_t n = 0;
+				while (got < file.text.size())
+				{
+					calls++;
+					n = pread(descriptor, &file.text[got], file.text.size() - got, (off_t)got);
+					if (n <= 0)
+						break;
+					got += (size_t)n;
+				}
+
+				// a file that shrank ends early, a failed read is not loaded
+				file.loaded = n >= 0;
+				file.text.resize(file.loaded ? got : 0);
+			}
+
+			calls++;
+			::close(descriptor);
+		}
+#else
+		std::ifstream input(file.filename, std::ios::binary);
+		if (input.is_open())
+		{
+			std::ostringstream text;
+			text << input.rdbuf();
+			file.text = text.str();
+			file.loaded = true;
+		}
+#endif
+
+		queue(std::move(file));
+
+		std::lock_guard<std::mutex> hold(lock);
+		if (stopping)
+			return;
+	}
+}
+
+bool FileLoader::readRing()
+{
+#ifdef __linux__
+	enum { Open = 0, Read = 1, Close = 2 };
+
+	for (size_t first = 0; first < files.size(); first += batch)
+	{
+		size_t count = std::min<size_t>(batch, files.size() - first);
+		std::vector<struct statx> sizes(count);
+		std::vector<LoadedFile> loaded(count);
+		std::vector<int> failed(count, 0);
+
+		// sizes of the whole batch first, so that every read is one exact read
+		for (size_t i = 0; i < count; i++)
+		{
+			loaded[i].index = first + i;
+			loaded[i].filename = files[first + i];
+
+			io_uring_sqe* entry = uring->prepare();
+			entry->opcode = IORING_OP_STATX;
+			entry->fd = AT_FDCWD;
+			entry->addr = (uint64_t)(uintptr_t)loaded[i].filename.c_str();
+			entry->len = STATX_SIZE;
+			entry->off = (uint64_t)(uintptr_t)&sizes[i];
+			entry->user_data = i;
+		}
+
+		// on a failure the submitted requests still write into the batch
+		auto fail = [this]()
+		{
+			uring->drain();
+			return false;
+		};
+
+		size_t reaped = 0;
+		if (!uring->submit((unsigned)count))
+			return fail();
+		while (reaped < count)
+		{
+			uint64_t data;
+			int result;
+			if (!uring->complete(data, result))
+			{
+				if (!uring->submit(1))
+					return fail();
+				continue;
+			}
+
+			failed[data] = result < 0 ? result : 0;
+			reaped++;
+		}
+
+		// open into the slot of the file, read it and close the slot; hard links
+		// close the slot even when the read comes up short
+		size_t expected = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (failed[i] != 0)
+				continue;
+
+			size_t size = (size_t)sizes[i].stx_size;
+			loaded[i].text.resize(size);
+
+			io_uring_sqe* entry = uring->prepare();
+			entry->opcode = IORING_OP_OPENAT;
+			entry->fd = AT_FDCWD;
+			entry->addr = (uint64_t)(uintptr_t)loaded[i].filename.c_str();
+			entry->open_flags = O_RDONLY; // direct descriptors are never inherited, O_CLOEXEC is refused
+			entry->file_index = (uint32_t)i + 1;
+			entry->flags = IOSQE_IO_HARDLINK;
+			entry->user_data = (i << 2) | Open;
+
+			entry = uring->prepare();
+			entry->opcode = IORING_OP_READ;
+			entry->fd = (int)i;
+			entry->addr = (uint64_t)(uintptr_t)loaded[i].text.data();
+			entry->len = (uint32_t)size;
+			entry->off = 0;
+			entry->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+			entry->user_data = (i << 2) | Read;
+
+			entry = uring->prepare();
+			entry->opcode = IORING_OP_CLOSE;
+			entry->file_index = (uint32_t)i + 1;
+			entry->user_data = (i << 2) | Close;
+
+			expected += 3;
+		}
+
+		reaped = 0;
+		bool unsupported = false;
+		if (expected > 0 && !uring->submit((unsigned)expected))
+			return fail();
+		while (reaped < expected)
+		{
+			uint64_t data;
+			int result;
+			if (!uring->complete(data, result))
+			{
+				if (!uring->submit(1))
+					return fail();
+				continue;
+			}
+
+			size_t i = (size_t)(data >> 2);
+			int op = (int)(data & 3);
+			if (op == Open && result < 0)
+			{
+				failed[i] = result;
+				unsupported |= result == -EINVAL;
+			}
+			else if (op == Read && failed[i] == 0)
+			{
+				if (result >= 0)
+				{
+					loaded[i].text.resize((size_t)result);
+					loaded[i].loaded = true;
+				}
+				else
+					failed[i] = result;
+			}
+			reaped++;
+		}
+
+		// kernels before direct descriptors reject the slots in openat too
+		if (unsupported && first == 0)
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!loaded[i].loaded)
+				loaded[i].text.clear();
+			queue(std::move(loaded[i]));
+		}
+
+		nextFile = first + count;
+
+		std::lock_guard<std::mutex> hold(lock);
+		if (stopping)
+			break;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char* loadMethodName(LoadMethod method)
+{
+	return method == LoadMethod::Uring ? "io_uring" : "pread";
+}
+
+long long countSystemCalls(const std::function<void()>& work)
+{
+#ifdef __linux__
+	std::cout.flush();
+
+	pid_t child = fork();
+	if (child < 0)
+		return -1;
+
+	if (child == 0)
+	{
+		if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0)
+			_exit(2);
+		raise(SIGSTOP);
+		work();
+		_exit(0);
+	}
+
+	int status = 0;
+	if (waitpid(child, &status, 0) < 0 || !WIFSTOPPED(status))
+		return -1;
+
+	long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+	if (ptrace(PTRACE_SETOPTIONS, child, nullptr, (void*)options) < 0)
+	{
+		kill(child, SIGKILL);
+		waitpid(child, &status, 0);
+		return -1;
+	}
+
+	// every thread of the child stops on entry to and on exit from each call
+	long long count = 0;
+	std::unordered_map<pid_t, bool> inside;
+	ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+
+	while (true)
+	{
+		pid_t thread = waitpid(-1, &status, __WALL);
+		if (thread < 0)
+			break;
+
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			inside.erase(thread);
+			if (thread == child)
+				break;
+			continue;
+		}
+
+		int signal = 0;
+		int stop = WSTOPSIG(status);
+		if (stop == (SIGTRAP | 0x80))
+		{
+			bool& in = inside[thread];
+			in = !in;
+			if (in)
+				count++;
+		}
+		else if (stop != SIGTRAP && stop != SIGSTOP)
+			signal = stop;
+
+		ptrace(PTRACE_SYSCALL, thread, nullptr, (void*)(long)signal);
+	}
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 2)
+		return -1;
+
+	return count;
+#else
+	(void)work;
+	return -1;
+#endif
+}
+
+// the files, with directories replaced by the .sig files under them
+static std::vector<std::string> sourceFiles(const std::vector<std::string>& paths)
+{
+	std::vector<std::string> files;
+
+	for (auto const& path : paths)
+	{
+		std::error_code ec;
+		if (!std::filesystem::is_directory(path, ec))
+		{
+			files.push_back(path);
+			continue;
+		}
+
+		std::vector<std::string> found;
+		std::filesystem::recursive_directory_iterator i(path, ec), end;
+		for (; !ec && i != end; i.increment(ec))
+		{
+			if (i->is_regular_file(ec) && i->path().extension() == ".sig")
+				found.push_back(i->path().string());
+		}
+
+		std::sort(found.begin(), found.end());
+		files.insert(files.end(), found.begin(), found.end());
+	}
+
+	return files;
+}
+
+void benchmarkLoading(const std::vector<std::string>& paths, unsigned int threads)
+{
+	std::vector<std::string> files = sourceFiles(paths);
+	if (files.empty())
+	{
+		std::cout << "Loader: Error: no files" << std::endl;
+		return;
+	}
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// the lexer opens the files itself, or compilers take them from a loader
+	auto compile = [&](int way)
+	{
+		std::atomic<size_t> nextFile{ 0 };
+		std::unique_ptr<FileLoader> loader;
+		if (way > 0)
+			loader = std::make_unique<FileLoader>(files, way == 1 ? LoadMethod::Pread : LoadMethod::Uring);
+
+		std::vector<std::thread> compilers;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			compilers.emplace_back([&]()
+			{
+				LoadedFile file;
+				while (true)
+				{
+					if (loader)
+					{
+						if (!loader->next(file))
+							return;
+						Parser par(SourceText{ file.text }, "", "");
+						par.startParsing();
+					}
+					else
+					{
+						size_t index = nextFile++;
+						if (index >= files.size())
+							return;
+						Parser par(files[index], "", "");
+						par.startParsing();
+					}
+				}
+			});
+		}
+
+		for (auto& compiler : compilers)
+			compiler.join();
+	};
+
+	// only the reading, traced in a child
+	auto load = [&](int way)
+	{
+		if (way == 0)
+		{
+			for (auto const& filename : files)
+			{
+				Lexer lexer;
+				lexer.startLexicalAnalyzer(filename);
+			}
+			return;
+		}
+
+		FileLoader loader(files, way == 1 ? LoadMethod::Pread : LoadMethod::Uring);
+		LoadedFile file;
+		while (loader.next(file))
+		{
+		}
+	};
+
+	FileLoader probe(std::vector<std::string>(), LoadMethod::Uring);
+	const char* names[] = { "ifstream", "pread", probe.loadMethod() == LoadMethod::Uring ? "io_uring" : "io_uring (pread fallback)" };
+
+	std::cout << "Loader: " << files.size() << " files, " << threads << " compiler threads" << std::endl;
+	for (int way = 0; way < 3; way++)
+	{
+		double best = -1;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			compile(way);
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			if (best < 0 || elapsed.count() < best)
+				best = elapsed.count();
+		}
+
+		long long calls = countSystemCalls([&]() { load(way); });
+
+		std::cout << names[way] << ":\t" << files.size() / best << " files/s, ";
+		if (calls < 0)
+			std::cout << "system calls not traced" << std::endl;
+		else
+			std::cout << (double)calls / files.size() << " system calls per file" << std::endl;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "uring.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+enum class LoadMethod
+{
+	Pread, // open, fstat, pread and close on a pool of threads
+	Uring // statx for a batch, then linked openat, read and close for it in one submission
+};
+
+struct LoadedFile
+{
+	size_t index = 0; // in the list of files
+	std::string filename = "";
+	std::string text = "";
+	bool loaded = false; // false when the file can't be opened or read
+};
+
+// Reads files ahead of the compilers, which take them in the order they
+// finish. At most a few hundred loaded files wait at a time, so readers
+// never run far ahead of slow consumers. Without io_uring (other systems,
+// old kernels, seccomp filters) the Uring method falls back to Pread.
+class FileLoader
+{
+private:
+	std::vector<std::string> files;
+	LoadMethod method;
+	unsigned int threads;
+	unsigned int batch;
+
+	std::unique_ptr<IoUring> uring;
+
+	std::mutex lock;
+	std::condition_variable ready; // a file was queued
+	std::condition_variable room; // a file was taken
+	std::deque<LoadedFile> done;
+	size_t maxQueued = 256;
+	size_t taken = 0;
+	bool stopping = false;
+
+	std::atomic<size_t> nextFile{ 0 };
+	std::atomic<size_t> calls{ 0 };
+	std::vector<std::thread> readers;
+
+public:
+	FileLoader(const std::vector<std::string>&, LoadMethod, unsigned int = 0, unsigned int = 64);
+	~FileLoader();
+
+	// false once every file has been taken
+	bool next(LoadedFile&);
+
+	LoadMethod loadMethod() const { return method; }
+	size_t systemCalls() const; // issued by the readers
+
+private:
+	void queue(LoadedFile&&);
+	void readPositional();
+	bool readRing();
+};
+
+const char* loadMethodName(LoadMethod);
+
+// system calls made by the function in a child process, -1 when they can't be traced
+long long countSystemCalls(const std::function<void()>&);
+
+// Compiles the files (or the .sig files under directories) with the ifstream
+// path of the lexer and with every load method, and reports files per second
+// and system calls per file
+void benchmarkLoading(const std::vector<std::string>&, unsigned int);
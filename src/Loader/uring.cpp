@@ -0,0 +1,253 @@
+#include "uring.h"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+static int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int ring, unsigned submit, unsigned wait, unsigned flags)
+{
+	return (int)syscall(__NR_io_uring_enter, ring, submit, wait, flags, nullptr, 0);
+}
+
+static int ioUringRegister(int ring, unsigned opcode, void* argument, unsigned count)
+{
+	return (int)syscall(__NR_io_uring_register, ring, opcode, argument, count);
+}
+
+IoUring::~IoUring()
+{
+	if (entries != nullptr)
+		munmap(entries, entryBytes);
+	if (completionMemory != nullptr && completionMemory != submissionMemory)
+		munmap(completionMemory, completionRing);
+	if (submissionMemory != nullptr)
+		munmap(submissionMemory, submissionRing);
+	if (ring >= 0)
+		close(ring);
+}
+
+bool IoUring::open(unsigned count)
+{
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+
+	ring = ioUringSetup(count, &params);
+	calls++;
+	if (ring < 0)
+		return false;
+
+	submissionRing = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	completionRing = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	// newer kernels map both rings at once
+	bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single)
+		submissionRing = completionRing = std::max(submissionRing, completionRing);
+
+	void* memory = mmap(nullptr, submissionRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+	calls++;
+	if (memory == MAP_FAILED)
+		return false;
+	submissionMemory = memory;
+
+	if (single)
+		completionMemory = submissionMemory;
+	else
+	{
+		memory = mmap(nullptr, completionRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+		calls++;
+		if (memory == MAP_FAILED)
+			return false;
+		completionMemory = memory;
+	}
+
+	entryBytes = params.sq_entries * sizeof(io_uring_sqe);
+	memory = mmap(nullptr, entryBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+	calls++;
+	if (memory == MAP_FAILED)
+		return false;
+	entries = (io_uring_sqe*)memory;
+
+	char* sq = (char*)submissionMemory;
+	sqHead = (unsigned*)(sq + params.sq_off.head);
+	sqTail = (unsigned*)(sq + params.sq_off.tail);
+	sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+	sqArray = (unsigned*)(sq + params.sq_off.array);
+
+	char* cq = (char*)completionMemory;
+	cqHead = (unsigned*)(cq + params.cq_off.head);
+	cqTail = (unsigned*)(cq + params.cq_off.tail);
+	cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	completions = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	capacity = params.sq_entries;
+	return true;
+}
+
+bool IoUring::isOpen() const
+{
+	return entries != nullptr;
+}
+
+bool IoUring::supports(const int* opcodes, size_t count)
+{
+	std::vector<unsigned char> memory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+	io_uring_probe* probe = (io_uring_probe*)memory.data();
+
+	calls++;
+	if (ioUringRegister(ring, IORING_REGISTER_PROBE, probe, 256) < 0)
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (opcodes[i] > probe->last_op || (probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool IoUring::registerFiles(unsigned count)
+{
+	std::vector<int> descriptors(count, -1);
+
+	calls++;
+	return ioUringRegister(ring, IORING_REGISTER_FILES, descriptors.data(), count) >= 0;
+}
+
+unsigned IoUring::entryCount() const
+{
+	return capacity;
+}
+
+size_t IoUring::systemCalls() const
+{
+	return calls;
+}
+
+io_uring_sqe* IoUring::prepare()
+{
+	unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	unsigned tail = *sqTail + queued;
+	if (tail - head >= capacity)
+		return nullptr;
+
+	unsigned index = tail & sqMask;
+	io_uring_sqe* entry = &entries[index];
+	std::memset(entry, 0, sizeof(*entry));
+	sqArray[index] = index;
+	queued++;
+
+	return entry;
+}
+
+bool IoUring::submit(unsigned wait)
+{
+	if (queued > 0)
+	{
+		__atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+		queued = 0;
+	}
+
+	// entries the kernel has not taken yet, also from earlier calls
+	unsigned pending = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	if (pending == 0 && wait == 0)
+		return true;
+
+	while (true)
+	{
+		calls++;
+		int result = ioUringEnter(ring, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+		if (result >= 0)
+			return true;
+		if (errno != EINTR)
+			return false;
+
+		pending = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	}
+}
+
+bool IoUring::complete(uint64_t& data, int& result)
+{
+	unsigned head = *cqHead;
+	if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+		return false;
+
+	const io_uring_cqe& completion = completions[head & cqMask];
+	data = completion.user_data;
+	result = completion.res;
+	__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+	reaped++;
+
+	return true;
+}
+
+bool IoUring::drain()
+{
+	queued = 0;
+	__atomic_store_n(sqTail, __atomic_load_n(sqHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+	// every submitted entry gets one completion, cancelled links too
+	while (__atomic_load_n(sqHead, __ATOMIC_ACQUIRE) != reaped)
+	{
+		uint64_t data;
+		int result;
+		if (complete(data, result))
+			continue;
+
+		calls++;
+		if (ioUringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+			return false;
+	}
+
+	return true;
+}
+
+#else
+
+IoUring::~IoUring()
+{
+}
+
+bool IoUring::open(unsigned)
+{
+	return false;
+}
+
+bool IoUring::isOpen() const
+{
+	return false;
+}
+
+bool IoUring::supports(const int*, size_t)
+{
+	return false;
+}
+
+bool IoUring::registerFiles(unsigned)
+{
+	return false;
+}
+
+unsigned IoUring::entryCount() const
+{
+	return 0;
+}
+
+size_t IoUring::systemCalls() const
+{
+	return 0;
+}
+
+#endif
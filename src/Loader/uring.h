@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+// Submission and completion rings of one io_uring instance, through the
+// system calls and the shared ring memory directly. Only the owning thread
+// may use it.
+class IoUring
+{
+#ifdef __linux__
+private:
+	int ring = -1;
+	size_t submissionRing = 0; // mapping sizes
+	size_t completionRing = 0;
+	size_t entryBytes = 0;
+	void* submissionMemory = nullptr;
+	void* completionMemory = nullptr;
+
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned sqMask = 0;
+	unsigned* sqArray = nullptr;
+	io_uring_sqe* entries = nullptr;
+	unsigned queued = 0; // prepared, not submitted yet
+
+	unsigned reaped = 0; // completions taken, the kernel's head counts the submissions
+
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned cqMask = 0;
+	io_uring_cqe* completions = nullptr;
+
+	unsigned capacity = 0;
+	size_t calls = 0;
+#endif
+
+public:
+	IoUring() {}
+	~IoUring();
+
+	IoUring(const IoUring&) = delete;
+	IoUring& operator=(const IoUring&) = delete;
+
+	// false when the kernel has no io_uring or refuses it
+	bool open(unsigned);
+	bool isOpen() const;
+
+	// every opcode is supported by the kernel
+	bool supports(const int*, size_t);
+	// a table of n direct descriptors, all empty
+	bool registerFiles(unsigned);
+
+	unsigned entryCount() const;
+	size_t systemCalls() const;
+
+#ifdef __linux__
+	// nullptr when the submission ring is full
+	io_uring_sqe* prepare();
+
+	// submits the prepared entries and waits for at least n completions
+	bool submit(unsigned);
+
+	// false when no completion is ready
+	bool complete(uint64_t&, int&);
+
+	// Takes back the entries the kernel has not taken and waits for the
+	// completions of the others, so that their buffers can be freed. False
+	// when the ring fails, the requests may still run then.
+	bool drain();
+#endif
+};
@@ -0,0 +1,487 @@
+#include "optimizer.h"
+#include "propagation.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <unordered_set>
+
+// values of identifiers and constants below a node, in source order
+static void collectOperands(const Node* root, std::vector<std::string>& operands)
+{
+	std::vector<const Node*> pending = { root };
+	while (!pending.empty())
+	{
+		const Node* n = pending.back();
+		pending.pop_back();
+
+		if (n->id >= 501)
+			operands.push_back(n->value);
+
+		for (auto i = n->leaf.rbegin(); i != n->leaf.rend(); ++i)
+			pending.push_back(i->get());
+	}
+}
+
+bool FlatProgram::fromTree(const Node* root)
+{
+	statements.clear();
+
+	if (root->leaf.empty() || root->leaf[0]->leaf.size() < 5)
+		return false;
+
+	const Node* program = root->leaf[0].get();
+
+	std::vector<std::string> names;
+	collectOperands(program->leaf[1].get(), names);
+	if (names.empty())
+		return false;
+	name = names[0];
+
+	const Node* block = program->leaf[3].get();
+	if (block->leaf.size() < 3)
+		return false;
+
+	// <statement-list> is <statement> <statement-list> or <empty>
+	const Node* list = block->leaf[1].get();
+	while (list->leaf.size() == 2)
+	{
+		const Node* s = list->leaf[0].get();
+		Statement statement;
+
+		while (!s->leaf.empty() && s->leaf[0]->value == "<unsigned-integer>")
+		{
+			if (s->leaf.size() < 3)
+				return false;
+
+			collectOperands(s->leaf[0].get(), statement.labels);
+			s = s->leaf[2].get();
+		}
+
+		if (s->leaf.empty())
+			return false;
+
+		const Node* first = s->leaf[0].get();
+		switch (first->id)
+		{
+		case 404: statement.kind = StatementKind::Goto; break;
+		case 405: statement.kind = StatementKind::Link; break;
+		case 406: statement.kind = StatementKind::In; break;
+		case 407: statement.kind = StatementKind::Out; break;
+		case 408: statement.kind = StatementKind::Return; break;
+		case 59: statement.kind = StatementKind::Empty; break;
+		case 301: statement.kind = StatementKind::Asm; break;
+		default:
+			if (first->value == "<variable-identifier>")
+				statement.kind = StatementKind::Assign;
+			else if (first->value == "<procedure-identifier>")
+				statement.kind = StatementKind::Call;
+			else
+				return false;
+		}
+
+		collectOperands(s, statement.operands);
+		statements.push_back(std::move(statement));
+
+		list = list->leaf[1].get();
+	}
+
+	return true;
+}
+
+std::string FlatProgram::toSource() const
+{
+	std::string s = "PROGRAM " + name + ";\nBEGIN\n";
+
+	for (auto const& i : statements)
+	{
+		s += "\t";
+		for (auto const& label : i.labels)
+			s += label + ": ";
+
+		const std::vector<std::string>& op = i.operands;
+		switch (i.kind)
+		{
+		case StatementKind::Assign: s += op[0] + " := " + op[1] + ";"; break;
+		case StatementKind::Goto: s += "GOTO " + op[0] + ";"; break;
+		case StatementKind::Link: s += "LINK " + op[0] + ", " + op[1] + ";"; break;
+		case StatementKind::In: s += "IN " + op[0] + ";"; break;
+		case StatementKind::Out: s += "OUT " + op[0] + ";"; break;
+		case StatementKind::Return: s += "RETURN;"; break;
+		case StatementKind::Empty: s += ";"; break;
+		case StatementKind::Asm: s += "($ " + op[0] + " $)"; break;
+		case StatementKind::Call:
+			s += op[0];
+			for (size_t a = 1; a < op.size(); a++)
+				s += (a == 1 ? " (" : ", ") + op[a];
+			s += op.size() > 1 ? ");" : ";";
+			break;
+		}
+
+		if (!i.comment.empty())
+			s += " (* " + i.comment + " *)";
+		s += "\n";
+	}
+
+	return s + "END;\n";
+}
+
+Optimizer::Optimizer(FlatProgram& p) : program(p)
+{
+}
+
+void Optimizer::run()
+{
+	// every step can expose work for the others
+	bool changed = true;
+	while (changed)
+	{
+		// unreachable inserts are removed, then their labels become free
+		hasAsm = false;
+		for (auto const& i : program.statements)
+			hasAsm |= i.kind == StatementKind::Asm;
+
+		changed = threadJumps();
+		changed |= removeUnreachable();
+		changed |= removeJumpsToNext();
+		changed |= removeUnusedLabels();
+		changed |= removeEmpty();
+	}
+}
+
+void ControlFlowGraph::indexLabels(const FlatProgram& program)
+{
+	labels.clear();
+	for (int i = 0; i < (int)program.statements.size(); i++)
+	{
+		for (auto const& label : program.statements[i].labels)
+			labels.emplace(label, i);
+	}
+}
+
+void ControlFlowGraph::build(const FlatProgram& program)
+{
+	indexLabels(program);
+	blocks.clear();
+
+	const std::vector<Statement>& s = program.statements;
+	blockOf.assign(s.size(), 0);
+
+	for (int i = 0; i < (int)s.size(); i++)
+	{
+		bool leader = i == 0 || !s[i].labels.empty() ||
+			s[i - 1].kind == StatementKind::Goto || s[i - 1].kind == StatementKind::Return;
+
+		if (leader)
+		{
+			BasicBlock b;
+			b.first = i;
+			blocks.push_back(b);
+		}
+
+		blocks.back().last = i + 1;
+		blockOf[i] = (int)blocks.size() - 1;
+	}
+
+	for (int b = 0; b < (int)blocks.size(); b++)
+	{
+		const Statement& last = s[blocks[b].last - 1];
+
+		if (last.kind == StatementKind::Goto)
+		{
+			auto target = labels.find(last.operands[0]);
+			if (target != labels.end())
+				blocks[b].successors.push_back(blockOf[target->second]);
+		}
+		else if (last.kind != StatementKind::Return && b + 1 < (int)blocks.size())
+		{
+			blocks[b].successors.push_back(b + 1);
+		}
+
+		for (int next : blocks[b].successors)
+			blocks[next].predecessors.push_back(b);
+	}
+}
+
+void ControlFlowGraph::markReachable(const FlatProgram& program, bool fromLabels)
+{
+	std::vector<int> pending;
+	if (!blocks.empty())
+		pending.push_back(0);
+
+	for (int b = 0; b < (int)blocks.size() && fromLabels; b++)
+	{
+		if (!program.statements[blocks[b].first].labels.empty())
+			pending.push_back(b);
+	}
+
+	while (!pending.empty())
+	{
+		int b = pending.back();
+		pending.pop_back();
+
+		if (blocks[b].reachable)
+			continue;
+
+		blocks[b].reachable = true;
+		for (int next : blocks[b].successors)
+			pending.push_back(next);
+	}
+}
+
+int Optimizer::skipEmpty(int i) const
+{
+	while (i < (int)program.statements.size() && program.statements[i].kind == StatementKind::Empty)
+		i++;
+
+	return i;
+}
+
+// where a GOTO to the label ends up after following GOTO chains,
+// running past the end of the program is a RETURN
+Optimizer::JumpTarget Optimizer::jumpTarget(const std::string& label)
+{
+	JumpTarget result;
+	std::vector<std::string> path;
+	std::unordered_set<std::string> onPath;
+	std::string current = label;
+
+	while (true)
+	{
+		auto known = targets.find(current);
+		if (known != targets.end())
+		{
+			result = known->second;
+			break;
+		}
+
+		auto l = cfg.labels.find(current);
+		if (l == cfg.labels.end())
+		{
+			result.label = current; // undefined label, left alone
+			break;
+		}
+
+		int i = skipEmpty(l->second);
+		if (i == (int)program.statements.size() || program.statements[i].kind == StatementKind::Return)
+		{
+			result.toReturn = true;
+			break;
+		}
+
+		if (program.statements[i].kind != StatementKind::Goto || onPath.count(current) != 0)
+		{
+			result.label = current; // real code or an endless loop
+			break;
+		}
+
+		path.push_back(current);
+		onPath.insert(current);
+		current = program.statements[i].operands[0];
+	}
+
+	// every label of the chain shares the result, so chains are walked once
+	for (auto const& p : path)
+		targets[p] = result;
+
+	return result;
+}
+
+bool Optimizer::threadJumps()
+{
+	cfg.indexLabels(program);
+	targets.clear();
+
+	bool changed = false;
+	for (auto& s : program.statements)
+	{
+		if (s.kind != StatementKind::Goto)
+			continue;
+
+		JumpTarget t = jumpTarget(s.operands[0]);
+		if (t.toReturn)
+		{
+			s.kind = StatementKind::Return;
+			s.operands.clear();
+		}
+		else if (t.label != s.operands[0])
+			s.operands[0] = t.label;
+		else
+			continue;
+
+		threaded++;
+		changed = true;
+	}
+
+	return changed;
+}
+
+bool Optimizer::removeUnreachable()
+{
+	cfg.build(program);
+	cfg.markReachable(program, hasAsm);
+
+	std::vector<bool> keep(program.statements.size(), true);
+	bool changed = false;
+
+	for (auto const& b : cfg.blocks)
+	{
+		if (b.reachable)
+			continue;
+
+		for (int i = b.first; i < b.last; i++)
+			keep[i] = false;
+		changed = true;
+	}
+
+	if (changed)
+		compact(keep);
+
+	return changed;
+}
+
+bool Optimizer::removeJumpsToNext()
+{
+	cfg.indexLabels(program);
+
+	std::vector<Statement>& s = program.statements;
+	std::vector<bool> keep(s.size(), true);
+	bool changed = false;
+
+	for (int i = 0; i < (int)s.size(); i++)
+	{
+		if (s[i].kind != StatementKind::Goto)
+			continue;
+
+		auto target = cfg.labels.find(s[i].operands[0]);
+		if (target == cfg.labels.end() || target->second <= i || skipEmpty(i + 1) < target->second)
+			continue;
+
+		if (s[i].labels.empty())
+			keep[i] = false;
+		else
+		{
+			s[i].kind = StatementKind::Empty;
+			s[i].operands.clear();
+		}
+		changed = true;
+	}
+
+	if (changed)
+		compact(keep);
+
+	return changed;
+}
+
+bool Optimizer::removeUnusedLabels()
+{
+	if (hasAsm)
+		return false;
+
+	std::unordered_set<std::string> used;
+	for (auto const& s : program.statements)
+	{
+		if (s.kind == StatementKind::Goto)
+			used.insert(s.operands[0]);
+	}
+
+	bool changed = false;
+	for (auto& s : program.statements)
+	{
+		size_t count = s.labels.size();
+		for (size_t i = 0; i < s.labels.size();)
+		{
+			if (used.count(s.labels[i]) == 0)
+				s.labels.erase(s.labels.begin() + i);
+			else
+				i++;
+		}
+
+		if (s.labels.size() != count)
+		{
+			removedLabels += count - s.labels.size();
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+bool Optimizer::removeEmpty()
+{
+	std::vector<bool> keep(program.statements.size(), true);
+	bool changed = false;
+
+	for (size_t i = 0; i < keep.size(); i++)
+	{
+		const Statement& s = program.statements[i];
+		if (s.kind == StatementKind::Empty && s.labels.empty())
+		{
+			keep[i] = false;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		compact(keep);
+
+	return changed;
+}
+
+void Optimizer::compact(const std::vector<bool>& keep)
+{
+	std::vector<Statement> kept;
+	kept.reserve(program.statements.size());
+
+	for (size_t i = 0; i < keep.size(); i++)
+	{
+		if (keep[i])
+			kept.push_back(std::move(program.statements[i]));
+	}
+
+	removedStatements += program.statements.size() - kept.size();
+	program.statements = std::move(kept);
+}
+
+void optimizePrograms(const std::vector<std::string>& files)
+{
+	for (auto const& filename : files)
+	{
+		Parser par(filename, "", "");
+		par.startParsing();
+
+		auto start = std::chrono::steady_clock::now();
+
+		FlatProgram program;
+		if (par.hasErrors() || !program.fromTree(par.getTree()))
+		{
+			std::cout << "Optimizer: Error (" << filename << "): program has errors, not optimized." << std::endl;
+			continue;
+		}
+
+		size_t before = program.statements.size();
+
+		Optimizer optimizer(program);
+		optimizer.run();
+
+		ConstantPropagation constants(program);
+		constants.run();
+		constants.rewrite();
+
+		// removed stores can leave empty statements and unused labels
+		if (constants.deadStoreCount() > 0)
+			optimizer.run();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::ofstream output(filename + ".opt.sig");
+		output << program.toSource();
+
+		std::cout << "Optimizer: " << filename << ": " << before << " -> " << program.statements.size()
+			<< " statements, " << optimizer.threadedCount() << " jumps threaded, "
+			<< optimizer.removedLabelCount() << " labels removed, "
+			<< constants.deadStoreCount() << " dead stores, "
+			<< constants.foldedCount() << " values folded, "
+			<< elapsed.count() * 1000 << " ms" << std::endl;
+	}
+}
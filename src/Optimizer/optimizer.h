@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../Parser/parser.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+enum class StatementKind
+{
+	Assign, // X := n;
+	Call, // P; or P (A, B);
+	Goto,
+	Link,
+	In,
+	Out,
+	Return,
+	Empty, // ;
+	Asm // ($ NAME $)
+};
+
+struct Statement
+{
+	std::vector<std::string> labels;
+	StatementKind kind = StatementKind::Empty;
+	std::vector<std::string> operands; // identifiers and constants in source order
+	std::string comment = ""; // printed as (* comment *) after the statement
+};
+
+// Statement list of a parsed program, flat instead of nested
+struct FlatProgram
+{
+	std::string name = "";
+	std::vector<Statement> statements;
+
+	// false for trees of programs with syntax errors
+	bool fromTree(const Node*);
+	std::string toSource() const;
+};
+
+struct BasicBlock
+{
+	int first = 0; // statements [first, last)
+	int last = 0;
+	std::vector<int> successors;
+	std::vector<int> predecessors;
+	bool reachable = false;
+};
+
+// Basic blocks of a flat program, split after GOTO and RETURN and before labels
+struct ControlFlowGraph
+{
+	std::vector<BasicBlock> blocks;
+	std::vector<int> blockOf; // statement -> block
+	std::unordered_map<std::string, int> labels; // label -> statement, the first definition wins
+
+	void indexLabels(const FlatProgram&);
+	void build(const FlatProgram&);
+
+	// from the first block, and from every labeled block when inserts may jump there
+	void markReachable(const FlatProgram&, bool);
+};
+
+// Control-flow optimizations on labels, GOTO and RETURN:
+// jump threading, unreachable code and unused label removal.
+class Optimizer
+{
+private:
+	struct JumpTarget
+	{
+		bool toReturn = false;
+		std::string label = "";
+	};
+
+	FlatProgram& program;
+
+	ControlFlowGraph cfg;
+	std::unordered_map<std::string, JumpTarget> targets;
+	bool hasAsm = false; // inserts may jump to any label
+
+	size_t threaded = 0;
+	size_t removedStatements = 0;
+	size_t removedLabels = 0;
+
+public:
+	Optimizer(FlatProgram&);
+
+	void run();
+
+	size_t threadedCount() const { return threaded; }
+	size_t removedStatementCount() const { return removedStatements; }
+	size_t removedLabelCount() const { return removedLabels; }
+
+private:
+	bool threadJumps();
+	bool removeUnreachable();
+	bool removeJumpsToNext();
+	bool removeUnusedLabels();
+	bool removeEmpty();
+
+	int skipEmpty(int) const;
+	JumpTarget jumpTarget(const std::string&);
+	void compact(const std::vector<bool>&);
+};
+
+// optimizes every program and writes "<file>.opt.sig"
+void optimizePrograms(const std::vector<std::string>&);
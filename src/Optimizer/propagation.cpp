@@ -0,0 +1,667 @@
+#include "propagation.h"
+
+#include <algorithm>
+#include <climits>
+
+ConstantPropagation::ConstantPropagation(FlatProgram& p) : program(p)
+{
+}
+
+void ConstantPropagation::run()
+{
+	analyzed = false;
+
+	for (auto const& s : program.statements)
+	{
+		if (s.kind == StatementKind::Asm)
+			return;
+	}
+
+	cfg.build(program);
+	cfg.markReachable(program, false);
+
+	collectEffects();
+
+	std::vector<int> order = reversePostorder();
+	computeDominators(order);
+	placePhis(order);
+	rename();
+	propagate();
+	markLive();
+
+	analyzed = true;
+
+	for (int i = 0; i < (int)program.statements.size(); i++)
+	{
+		const Statement& s = program.statements[i];
+
+		if (isDeadStore(i))
+			deadStores++;
+		else if (s.kind == StatementKind::Out && !outputValue(i).empty())
+			folded++;
+		else if (s.kind == StatementKind::Link && !valueAt(i, s.operands[0]).empty())
+			folded++;
+	}
+}
+
+int ConstantPropagation::variable(const std::string& name)
+{
+	auto i = variables.find(name);
+	if (i != variables.end())
+		return i->second;
+
+	int id = (int)variableNames.size();
+	variables.emplace(name, id);
+	variableNames.push_back(name);
+	return id;
+}
+
+void ConstantPropagation::collectEffects()
+{
+	const std::vector<Statement>& s = program.statements;
+
+	// a port is bound to the variables of every reachable LINK for the whole program
+	for (int i = 0; i < (int)s.size(); i++)
+	{
+		if (s[i].kind == StatementKind::Assign)
+			variable(s[i].operands[0]);
+		else if (s[i].kind == StatementKind::Call)
+		{
+			for (size_t a = 1; a < s[i].operands.size(); a++)
+				variable(s[i].operands[a]);
+		}
+		else if (s[i].kind == StatementKind::Link)
+		{
+			int v = variable(s[i].operands[0]);
+			if (!cfg.blocks[cfg.blockOf[i]].reachable)
+				continue;
+
+			std::vector<int>& bound = ports[s[i].operands[1]];
+			portLinks[s[i].operands[1]].push_back(i);
+
+			if (std::find(bound.begin(), bound.end(), v) == bound.end())
+				bound.push_back(v);
+			if (std::find(linked.begin(), linked.end(), v) == linked.end())
+				linked.push_back(v);
+		}
+	}
+
+	effects.assign(s.size(), Effect());
+	std::vector<int> seen(variableNames.size(), -1); // statement that last used the variable
+
+	for (int i = 0; i < (int)s.size(); i++)
+	{
+		Effect& e = effects[i];
+		const std::vector<std::string>& op = s[i].operands;
+
+		auto clobber = [&](int v)
+		{
+			if (seen[v] == i)
+				return;
+			seen[v] = i;
+			e.reads.push_back(v);
+			e.writes.push_back({ v, "" });
+		};
+
+		switch (s[i].kind)
+		{
+		case StatementKind::Assign:
+			e.writes.push_back({ variables[op[0]], op[1] });
+			break;
+
+		case StatementKind::Call:
+			for (size_t a = 1; a < op.size(); a++)
+				clobber(variables[op[a]]);
+			for (int v : linked)
+				clobber(v);
+			break;
+
+		case StatementKind::Link:
+			e.reads.push_back(variables[op[0]]); // the value becomes visible on the port
+			break;
+
+		case StatementKind::In:
+		case StatementKind::Out:
+		{
+			auto bound = ports.find(op[0]);
+			if (bound == ports.end())
+				break;
+
+			// the port may not be bound yet, so IN keeps the old value alive
+			for (int v : bound->second)
+			{
+				e.reads.push_back(v);
+				if (s[i].kind == StatementKind::In)
+					e.writes.push_back({ v, "" });
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+}
+
+std::vector<int> ConstantPropagation::reversePostorder()
+{
+	int entry = (int)cfg.blocks.size();
+
+	predecessors.assign(entry + 1, std::vector<int>());
+	if (entry > 0)
+		predecessors[0].push_back(entry);
+
+	for (int b = 0; b < entry; b++)
+	{
+		if (!cfg.blocks[b].reachable)
+			continue;
+
+		for (int next : cfg.blocks[b].successors)
+			predecessors[next].push_back(b);
+	}
+
+	std::vector<int> order;
+	std::vector<bool> visited(entry + 1, false);
+	std::vector<std::pair<int, bool>> pending = { { entry, false } };
+
+	while (!pending.empty())
+	{
+		auto [node, done] = pending.back();
+		pending.pop_back();
+
+		if (done)
+		{
+			order.push_back(node);
+			continue;
+		}
+
+		if (visited[node])
+			continue;
+		visited[node] = true;
+
+		pending.push_back({ node, true });
+
+		if (node == entry)
+		{
+			if (entry > 0)
+				pending.push_back({ 0, false });
+		}
+		else
+		{
+			for (int next : cfg.blocks[node].successors)
+				pending.push_back({ next, false });
+		}
+	}
+
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+void ConstantPropagation::computeDominators(const std::vector<int>& order)
+{
+	int entry = (int)cfg.blocks.size();
+
+	std::vector<int> position(entry + 1, -1);
+	for (int i = 0; i < (int)order.size(); i++)
+		position[order[i]] = i;
+
+	idom.assign(entry + 1, -1);
+	idom[entry] = entry;
+
+	auto intersect = [&](int a, int b)
+	{
+		while (a != b)
+		{
+			while (position[a] > position[b])
+				a = idom[a];
+			while (position[b] > position[a])
+				b = idom[b];
+		}
+		return a;
+	};
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		for (int node : order)
+		{
+			if (node == entry)
+				continue;
+
+			int dominator = -1;
+			for (int p : predecessors[node])
+			{
+				if (idom[p] < 0)
+					continue;
+				dominator = dominator < 0 ? p : intersect(p, dominator);
+			}
+
+			if (dominator != idom[node])
+			{
+				idom[node] = dominator;
+				changed = true;
+			}
+		}
+	}
+}
+
+int ConstantPropagation::addDefinition(int v, int statement, Lattice state, const std::string& value)
+{
+	Definition d;
+	d.variable = v;
+	d.statement = statement;
+	d.state = state;
+	d.value = value;
+
+	definitions.push_back(std::move(d));
+	return (int)definitions.size() - 1;
+}
+
+// phis go to the iterated dominance frontier of the blocks that define a variable
+void ConstantPropagation::placePhis(const std::vector<int>& order)
+{
+	int entry = (int)cfg.blocks.size();
+	long long count = (long long)variableNames.size();
+
+	std::vector<std::vector<int>> frontier(entry + 1);
+	for (int node : order)
+	{
+		if (predecessors[node].size() < 2)
+			continue;
+
+		for (int p : predecessors[node])
+		{
+			for (int runner = p; runner != idom[node]; runner = idom[runner])
+			{
+				if (frontier[runner].empty() || frontier[runner].back() != node)
+					frontier[runner].push_back(node);
+			}
+		}
+	}
+
+	// the entry defines every variable and dominates everything, so only real definitions matter
+	std::vector<std::vector<int>> definingBlocks(variableNames.size());
+	for (int i = 0; i < (int)effects.size(); i++)
+	{
+		int b = cfg.blockOf[i];
+		if (!cfg.blocks[b].reachable)
+			continue;
+
+		for (auto const& w : effects[i].writes)
+		{
+			std::vector<int>& blocks = definingBlocks[w.first];
+			if (blocks.empty() || blocks.back() != b)
+				blocks.push_back(b);
+		}
+	}
+
+	blockPhis.assign(entry + 1, std::vector<int>());
+	std::vector<int> queued(entry + 1, -1); // variable that last queued the block
+
+	for (int v = 0; v < (int)variableNames.size(); v++)
+	{
+		std::vector<int> pending;
+		for (int b : definingBlocks[v])
+		{
+			if (queued[b] != v)
+			{
+				queued[b] = v;
+				pending.push_back(b);
+			}
+		}
+
+		while (!pending.empty())
+		{
+			int b = pending.back();
+			pending.pop_back();
+
+			for (int d : frontier[b])
+			{
+				long long key = d * count + v;
+				if (phiIndex.count(key) != 0)
+					continue;
+
+				int phi = addDefinition(v, -1, Lattice::Top, "");
+				definitions[phi].phi = true;
+				definitions[phi].operands.assign(predecessors[d].size(), -1);
+
+				phiIndex.emplace(key, phi);
+				blockPhis[d].push_back(phi);
+
+				if (queued[d] != v)
+				{
+					queued[d] = v;
+					pending.push_back(d);
+				}
+			}
+		}
+	}
+}
+
+void ConstantPropagation::rename()
+{
+	int entry = (int)cfg.blocks.size();
+	int count = (int)variableNames.size();
+
+	std::vector<std::vector<int>> children(entry + 1);
+	for (int node = 0; node < entry; node++)
+	{
+		if (idom[node] >= 0)
+			children[idom[node]].push_back(node);
+	}
+
+	// position of every edge in the predecessor list of its target
+	std::vector<std::vector<int>> edgeIndex(entry + 1);
+	for (int node = 0; node <= entry; node++)
+	{
+		for (int i = 0; i < (int)predecessors[node].size(); i++)
+			edgeIndex[predecessors[node][i]].push_back(i);
+	}
+
+	std::vector<std::vector<int>> stacks(count);
+	std::vector<int> trail; // variables pushed by the open blocks
+	definitionsOf.assign(count, std::vector<std::pair<int, int>>());
+
+	entryDefinitions.resize(count);
+	for (int v = 0; v < count; v++)
+		entryDefinitions[v] = addDefinition(v, -1, Lattice::Bottom, "");
+
+	struct Frame
+	{
+		int node;
+		size_t trailSize;
+		size_t child;
+	};
+
+	std::vector<Frame> frames = { { entry, 0, 0 } };
+	bool entering = true;
+	int counter = 0;
+
+	domEnter.assign(entry + 1, -1);
+	domExit.assign(entry + 1, -1);
+
+	while (!frames.empty())
+	{
+		Frame& f = frames.back();
+
+		if (entering)
+		{
+			int node = f.node;
+			f.trailSize = trail.size();
+			domEnter[node] = counter++;
+
+			std::vector<int> successors;
+			if (node == entry)
+			{
+				for (int v = 0; v < count; v++)
+				{
+					stacks[v].push_back(entryDefinitions[v]);
+					trail.push_back(v);
+				}
+
+				if (entry > 0)
+					successors.push_back(0);
+			}
+			else
+			{
+				for (int phi : blockPhis[node])
+				{
+					stacks[definitions[phi].variable].push_back(phi);
+					trail.push_back(definitions[phi].variable);
+				}
+
+				for (int i = cfg.blocks[node].first; i < cfg.blocks[node].last; i++)
+				{
+					Effect& e = effects[i];
+
+					for (int v : e.reads)
+						e.readDefinitions.push_back(stacks[v].back());
+
+					for (auto const& w : e.writes)
+					{
+						int d = addDefinition(w.first, i, w.second.empty() ? Lattice::Bottom : Lattice::Constant, w.second);
+						e.writeDefinitions.push_back(d);
+						definitionsOf[w.first].push_back({ i, d });
+
+						stacks[w.first].push_back(d);
+						trail.push_back(w.first);
+					}
+				}
+
+				successors = cfg.blocks[node].successors;
+
+				if (successors.empty())
+				{
+					for (int v : linked)
+						exitReads.push_back(stacks[v].back());
+				}
+			}
+
+			for (size_t s = 0; s < successors.size(); s++)
+			{
+				int next = successors[s];
+				int slot = edgeIndex[node][s];
+
+				for (int phi : blockPhis[next])
+				{
+					int d = stacks[definitions[phi].variable].back();
+					definitions[phi].operands[slot] = d;
+					definitions[d].users.push_back(phi);
+				}
+			}
+		}
+
+		if (f.child < children[f.node].size())
+		{
+			int next = children[f.node][f.child++];
+			frames.push_back({ next, 0, 0 });
+			entering = true;
+			continue;
+		}
+
+		while (trail.size() > f.trailSize)
+		{
+			stacks[trail.back()].pop_back();
+			trail.pop_back();
+		}
+
+		domExit[f.node] = counter++;
+
+		frames.pop_back();
+		entering = false;
+	}
+
+	for (auto& list : definitionsOf)
+		std::sort(list.begin(), list.end());
+}
+
+// optimistic: phis start unknown and only move down the lattice
+void ConstantPropagation::propagate()
+{
+	std::vector<int> pending;
+	for (int d = 0; d < (int)definitions.size(); d++)
+	{
+		if (definitions[d].phi)
+			pending.push_back(d);
+	}
+
+	while (!pending.empty())
+	{
+		Definition& phi = definitions[pending.back()];
+		pending.pop_back();
+
+		Lattice state = Lattice::Top;
+		std::string value = "";
+
+		for (int op : phi.operands)
+		{
+			const Definition& d = definitions[op];
+			if (d.state == Lattice::Top)
+				continue;
+
+			if (d.state == Lattice::Bottom || (state == Lattice::Constant && d.value != value))
+			{
+				state = Lattice::Bottom;
+				break;
+			}
+
+			state = Lattice::Constant;
+			value = d.value;
+		}
+
+		if (state == phi.state && value == phi.value)
+			continue;
+
+		phi.state = state;
+		phi.value = value;
+		pending.insert(pending.end(), phi.users.begin(), phi.users.end());
+	}
+}
+
+void ConstantPropagation::markLive()
+{
+	std::vector<int> pending = exitReads;
+
+	for (int i = 0; i < (int)effects.size(); i++)
+	{
+		if (cfg.blocks[cfg.blockOf[i]].reachable)
+			pending.insert(pending.end(), effects[i].readDefinitions.begin(), effects[i].readDefinitions.end());
+	}
+
+	while (!pending.empty())
+	{
+		Definition& d = definitions[pending.back()];
+		pending.pop_back();
+
+		if (d.live)
+			continue;
+
+		d.live = true;
+		pending.insert(pending.end(), d.operands.begin(), d.operands.end());
+	}
+}
+
+// the last definition before the statement in its block, or in a dominating block
+int ConstantPropagation::reachingDefinition(int v, int statement) const
+{
+	int entry = (int)cfg.blocks.size();
+	const std::vector<std::pair<int, int>>& list = definitionsOf[v];
+
+	int node = cfg.blockOf[statement];
+	int bound = statement;
+
+	while (node != entry)
+	{
+		auto i = std::lower_bound(list.begin(), list.end(), std::make_pair(bound, INT_MIN));
+		if (i != list.begin() && (--i)->first >= cfg.blocks[node].first)
+			return i->second;
+
+		auto phi = phiIndex.find(node * (long long)variableNames.size() + v);
+		if (phi != phiIndex.end())
+			return phi->second;
+
+		node = idom[node];
+		if (node != entry)
+			bound = cfg.blocks[node].last;
+	}
+
+	return entryDefinitions[v];
+}
+
+// statement a runs before b on every path to b
+bool ConstantPropagation::dominates(int a, int b) const
+{
+	int x = cfg.blockOf[a];
+	int y = cfg.blockOf[b];
+
+	if (x == y)
+		return a < b;
+
+	return domEnter[x] < domEnter[y] && domExit[y] < domExit[x];
+}
+
+std::string ConstantPropagation::constantOf(int d) const
+{
+	return definitions[d].state == Lattice::Constant ? definitions[d].value : "";
+}
+
+std::string ConstantPropagation::valueAt(int statement, const std::string& name) const
+{
+	if (!analyzed || statement < 0 || statement >= (int)program.statements.size() ||
+		!cfg.blocks[cfg.blockOf[statement]].reachable)
+		return "";
+
+	auto v = variables.find(name);
+	if (v == variables.end())
+		return "";
+
+	return constantOf(reachingDefinition(v->second, statement));
+}
+
+std::string ConstantPropagation::outputValue(int statement) const
+{
+	if (!analyzed || statement < 0 || statement >= (int)program.statements.size() ||
+		program.statements[statement].kind != StatementKind::Out ||
+		!cfg.blocks[cfg.blockOf[statement]].reachable)
+		return "";
+
+	// one variable on the port, certainly bound by a LINK before the OUT
+	const Effect& e = effects[statement];
+	if (e.readDefinitions.size() != 1)
+		return "";
+
+	const std::vector<int>& links = portLinks.at(program.statements[statement].operands[0]);
+	if (std::none_of(links.begin(), links.end(), [&](int link) { return dominates(link, statement); }))
+		return "";
+
+	return constantOf(e.readDefinitions[0]);
+}
+
+bool ConstantPropagation::isDeadStore(int statement) const
+{
+	if (!analyzed || statement < 0 || statement >= (int)program.statements.size() ||
+		program.statements[statement].kind != StatementKind::Assign ||
+		!cfg.blocks[cfg.blockOf[statement]].reachable)
+		return false;
+
+	return !definitions[effects[statement].writeDefinitions[0]].live;
+}
+
+void ConstantPropagation::rewrite()
+{
+	if (!analyzed)
+		return;
+
+	std::vector<Statement> kept;
+	kept.reserve(program.statements.size());
+
+	for (int i = 0; i < (int)program.statements.size(); i++)
+	{
+		Statement& s = program.statements[i];
+
+		if (isDeadStore(i))
+		{
+			if (s.labels.empty())
+				continue;
+
+			s.kind = StatementKind::Empty;
+			s.operands.clear();
+		}
+		else if (s.kind == StatementKind::Out && !outputValue(i).empty())
+		{
+			s.comment = variableNames[effects[i].reads[0]] + " = " + outputValue(i);
+		}
+		else if (s.kind == StatementKind::Link && !valueAt(i, s.operands[0]).empty())
+		{
+			s.comment = s.operands[0] + " = " + valueAt(i, s.operands[0]);
+		}
+
+		kept.push_back(std::move(s));
+	}
+
+	program.statements = std::move(kept);
+	analyzed = false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "optimizer.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+// Values of variables along the control-flow graph. Every assignment and
+// every statement that may change a variable is a definition in SSA form,
+// joins get phi definitions, and values only flow along def-use edges.
+//
+// Calls may read and change their arguments and every variable of a LINK,
+// IN/OUT may use any variable linked to their port somewhere in the program.
+// Programs with assembly inserts are not analyzed.
+class ConstantPropagation
+{
+private:
+	enum class Lattice
+	{
+		Top, // not known yet, only phis start here
+		Constant,
+		Bottom // more than one value or unknown
+	};
+
+	struct Definition
+	{
+		int variable = -1;
+		int statement = -1; // -1 for entry and phi definitions
+		bool phi = false;
+		std::vector<int> operands; // phi: one definition per predecessor
+		std::vector<int> users; // phis reading it
+
+		Lattice state = Lattice::Bottom;
+		std::string value = "";
+		bool live = false;
+	};
+
+	struct Effect
+	{
+		std::vector<int> reads; // variables
+		std::vector<std::pair<int, std::string>> writes; // variable, constant or "" when unknown
+
+		std::vector<int> readDefinitions; // parallel to reads
+		std::vector<int> writeDefinitions; // parallel to writes
+	};
+
+	FlatProgram& program;
+	ControlFlowGraph cfg;
+	bool analyzed = false;
+
+	std::unordered_map<std::string, int> variables;
+	std::vector<std::string> variableNames;
+	std::unordered_map<std::string, std::vector<int>> ports; // port -> linked variables
+	std::unordered_map<std::string, std::vector<int>> portLinks; // port -> LINK statements
+	std::vector<int> linked;
+
+	std::vector<Effect> effects;
+	std::vector<Definition> definitions;
+	std::vector<std::vector<std::pair<int, int>>> definitionsOf; // variable -> (statement, definition)
+	std::vector<int> entryDefinitions; // by variable
+	std::vector<int> exitReads; // definitions observed when the program ends
+
+	// graph of the reachable blocks, node blocks.size() is the entry
+	std::vector<std::vector<int>> predecessors;
+	std::vector<int> idom;
+	std::vector<int> domEnter; // dominator tree preorder intervals
+	std::vector<int> domExit;
+	std::vector<std::vector<int>> blockPhis;
+	std::unordered_map<long long, int> phiIndex; // node * variables + variable -> definition
+
+	size_t deadStores = 0;
+	size_t folded = 0;
+
+public:
+	ConstantPropagation(FlatProgram&);
+
+	void run();
+
+	// value just before the statement, "" when it is not a known constant
+	std::string valueAt(int, const std::string&) const;
+	// value written by "OUT n;", "" when unknown
+	std::string outputValue(int) const;
+	bool isDeadStore(int) const;
+
+	// removes dead stores and notes known values of LINK and OUT statements
+	// as comments; statement numbers change, so the results are dropped
+	void rewrite();
+
+	size_t deadStoreCount() const { return deadStores; }
+	size_t foldedCount() const { return folded; }
+
+private:
+	int variable(const std::string&);
+	void collectEffects();
+
+	std::vector<int> reversePostorder();
+	void computeDominators(const std::vector<int>&);
+	void placePhis(const std::vector<int>&);
+	void rename();
+	void propagate();
+	void markLive();
+
+	int addDefinition(int, int, Lattice, const std::string&);
+	int reachingDefinition(int, int) const;
+	bool dominates(int, int) const;
+	std::string constantOf(int) const;
+};
@@ -0,0 +1,506 @@
+#include "parser.h"
+
+#include <array>
+#include <climits>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+// Table-driven LL(1) version of the recursive descent in parser.cpp.
+// It builds the same tree and reports the same first error, but keeps the
+// grammar symbols on an explicit stack instead of the call stack.
+
+namespace
+{
+	enum TokenClass
+	{
+		T_Program, T_Begin, T_End, T_Goto, T_Link, T_In, T_Out, T_Return,
+		T_Semicolon, T_Comma, T_Colon, T_LeftParen, T_RightParen, T_Assign,
+		T_AsmOpen, T_AsmClose, T_Constant, T_Identifier, T_Other,
+		TokenClassCount
+	};
+
+	enum Nonterminal
+	{
+		N_Program = TokenClassCount, N_Block, N_StatementsList, N_Statement,
+		N_ActualArgs, N_ArgsTail, N_ActualArgsList,
+		N_VarIdentifier, N_ProcIdentifier, N_AsmIdentifier, N_Identifier, N_UInteger,
+		NonterminalEnd
+	};
+
+	enum Action
+	{
+		A_Leave = NonterminalEnd, // the node of an expanded nonterminal is complete
+		A_Empty // "<empty>" leaf
+	};
+
+	const int NonterminalCount = NonterminalEnd - N_Program;
+
+	// node names, nullptr for helper nonterminals that don't appear in the tree
+	const char* const nodeNames[NonterminalCount] = {
+		"<program>", "<block>", "<statement-list>", "<statement>",
+		"<actual-arguments>", nullptr, "<actual-arguments-list>",
+		"<variable-identifier>", "<procedure-identifier>", "<assembly-insert-file-identifier>",
+		"<identifier>", "<unsigned-integer>"
+	};
+
+	// "<x> expected." messages for a terminal mismatch
+	const char* const terminalNames[TokenClassCount] = {
+		"keyword 'PROGRAM'", "keyword 'BEGIN'", "keyword 'END'", "keyword 'GOTO'",
+		"keyword 'LINK'", "keyword 'IN'", "keyword 'OUT'", "keyword 'RETURN'",
+		"';'", "','", "':'", "'('", "')'", "':='", "'($'", "'$)'",
+		"<unsigned-integer>", "<identifier>", "<token>"
+	};
+
+	// right-hand sides, terminated by -1
+	enum ProductionId
+	{
+		P_Program, P_Block, P_StatementsList, P_StatementsEmpty,
+		P_Label, P_Assign, P_Call, P_Goto, P_Link, P_In, P_Out, P_Return, P_EmptyStatement, P_Asm,
+		P_Args, P_ArgsEmpty, P_ArgsTail, P_ArgsTailEnd, P_ArgsList, P_ArgsListEmpty,
+		P_VarIdentifier, P_ProcIdentifier, P_AsmIdentifier, P_Identifier, P_UInteger,
+		ProductionCount,
+		P_AssignOrCall = ProductionCount, // resolved by the token after the identifier
+		P_None = -1
+	};
+
+	const int productions[ProductionCount][8] = {
+		{ T_Program, N_ProcIdentifier, T_Semicolon, N_Block, T_Semicolon, -1 },
+		{ T_Begin, N_StatementsList, T_End, -1 },
+		{ N_Statement, N_StatementsList, -1 },
+		{ A_Empty, -1 },
+		{ N_UInteger, T_Colon, N_Statement, -1 },
+		{ N_VarIdentifier, T_Assign, N_UInteger, T_Semicolon, -1 },
+		{ N_ProcIdentifier, N_ActualArgs, T_Semicolon, -1 },
+		{ T_Goto, N_UInteger, T_Semicolon, -1 },
+		{ T_Link, N_VarIdentifier, T_Comma, N_UInteger, T_Semicolon, -1 },
+		{ T_In, N_UInteger, T_Semicolon, -1 },
+		{ T_Out, N_UInteger, T_Semicolon, -1 },
+		{ T_Return, T_Semicolon, -1 },
+		{ T_Semicolon, -1 },
+		{ T_AsmOpen, N_AsmIdentifier, T_AsmClose, -1 },
+		{ T_LeftParen, N_VarIdentifier, N_ArgsTail, T_RightParen, -1 },
+		{ A_Empty, -1 },
+		{ N_ActualArgsList, -1 },
+		{ -1 },
+		{ T_Comma, N_VarIdentifier, N_ArgsTail, -1 },
+		{ A_Empty, -1 },
+		{ N_Identifier, -1 },
+		{ N_Identifier, -1 },
+		{ N_Identifier, -1 },
+		{ T_Identifier, -1 },
+		{ T_Constant, -1 },
+	};
+
+	typedef std::array<std::array<int, TokenClassCount>, NonterminalCount> ParseTable;
+
+	ParseTable buildTable()
+	{
+		ParseTable table;
+		for (auto& row : table)
+			row.fill(P_None);
+
+		auto all = [&](int nonterminal, int production)
+		{
+			table[nonterminal - N_Program].fill(production);
+		};
+		auto set = [&](int nonterminal, int token, int production)
+		{
+			table[nonterminal - N_Program][token] = production;
+		};
+
+		// the recursive descent never looks ahead before these, a wrong token
+		// is reported by the first terminal of the production
+		all(N_Program, P_Program);
+		all(N_Block, P_Block);
+		all(N_VarIdentifier, P_VarIdentifier);
+		all(N_ProcIdentifier, P_ProcIdentifier);
+		all(N_AsmIdentifier, P_AsmIdentifier);
+		all(N_Identifier, P_Identifier);
+		all(N_UInteger, P_UInteger);
+
+		all(N_StatementsList, P_StatementsList);
+		set(N_StatementsList, T_End, P_StatementsEmpty);
+
+		set(N_Statement, T_Constant, P_Label);
+		set(N_Statement, T_Identifier, P_AssignOrCall);
+		set(N_Statement, T_Goto, P_Goto);
+		set(N_Statement, T_Link, P_Link);
+		set(N_Statement, T_In, P_In);
+		set(N_Statement, T_Out, P_Out);
+		set(N_Statement, T_Return, P_Return);
+		set(N_Statement, T_Semicolon, P_EmptyStatement);
+		set(N_Statement, T_AsmOpen, P_Asm);
+
+		set(N_ActualArgs, T_LeftParen, P_Args);
+		set(N_ActualArgs, T_Semicolon, P_ArgsEmpty);
+
+		// an argument list node only appears when ')' doesn't follow right away
+		all(N_ArgsTail, P_ArgsTail);
+		set(N_ArgsTail, T_RightParen, P_ArgsTailEnd);
+
+		all(N_ActualArgsList, P_ArgsListEmpty);
+		set(N_ActualArgsList, T_Comma, P_ArgsList);
+
+		return table;
+	}
+
+	int tokenClass(int id)
+	{
+		switch (id)
+		{
+		case 401: return T_Program;
+		case 402: return T_Begin;
+		case 403: return T_End;
+		case 404: return T_Goto;
+		case 405: return T_Link;
+		case 406: return T_In;
+		case 407: return T_Out;
+		case 408: return T_Return;
+		case 59: return T_Semicolon;
+		case 44: return T_Comma;
+		case 58: return T_Colon;
+		case 40: return T_LeftParen;
+		case 41: return T_RightParen;
+		case 303: return T_Assign;
+		case 301: return T_AsmOpen;
+		case 302: return T_AsmClose;
+		}
+
+		if (id >= 1001)
+			return T_Identifier;
+		if (id >= 501 && id <= 1000)
+			return T_Constant;
+
+		return T_Other;
+	}
+}
+
+void Parser::parseTable()
+{
+	TableRun run;
+	run.par = par;
+	run.end = streamed ? INT_MAX : (int)lexer.tokens.size();
+	run.stream = streamed ? &lexer : nullptr;
+	run.symbol = N_Program;
+	run.events = events;
+	run.parents = { head.get() };
+	run.parallel = engine == ParserEngine::Parallel;
+
+	runTable(run);
+
+	par = run.par;
+	asmInserts.insert(asmInserts.end(), run.asmInserts.begin(), run.asmInserts.end());
+
+	if (run.failed)
+		showError(run.error);
+}
+
+// only reads the parser, so runs over different token ranges can share it
+void Parser::runTable(TableRun& run) const
+{
+	static const ParseTable table = buildTable();
+
+	std::vector<TableRun::Entry>& symbols = run.symbols;
+	symbols.assign(1, { run.symbol, 1 });
+
+	auto push = [&](int symbol)
+	{
+		if (symbol == A_Leave && !symbols.empty() && symbols.back().symbol == A_Leave)
+			symbols.back().count++;
+		else
+			symbols.push_back({ symbol, 1 });
+	};
+
+	auto nextToken = [&]()
+	{
+		const Token* t = nullptr;
+		if (run.stream != nullptr)
+			t = run.stream->streamToken(run.par.index);
+		else if (run.par.index < run.end)
+			t = &lexer.tokens[run.par.index];
+
+		if (t != nullptr)
+		{
+			run.par.id = t->id;
+			run.par.offset = t->offset;
+			run.par.index++;
+		}
+		else
+			run.par.id = 0; // end of tokens, keeps the position of the last one
+	};
+
+	auto terminal = [&](const std::string& value, int id, int offset)
+	{
+		if (run.events != nullptr)
+			run.events->terminal(id, value, offset);
+		else
+			appendNode(run.parents.back(), value, id, offset);
+	};
+
+	auto fail = [&](const char* name)
+	{
+		run.failed = true;
+		run.error = name;
+	};
+
+	nextToken();
+
+	while (!symbols.empty())
+	{
+		int symbol = symbols.back().symbol;
+		if (--symbols.back().count == 0)
+			symbols.pop_back();
+
+		int token = tokenClass(run.par.id);
+
+		if (symbol < TokenClassCount)
+		{
+			if (token != symbol)
+			{
+				fail(terminalNames[symbol]);
+				break;
+			}
+
+			terminal(findInTable(run.par.id), run.par.id, run.par.offset);
+			nextToken();
+		}
+		else if (symbol == A_Leave)
+		{
+			if (run.events != nullptr)
+				run.events->leave();
+			else
+				run.parents.pop_back();
+		}
+		else if (symbol == A_Empty)
+		{
+			terminal("<empty>", 0, -1);
+		}
+		else
+		{
+			if (symbol == N_StatementsList && run.parallel)
+			{
+				// the statements up to END are parsed by the workers, the
+				// rest of the list is expanded here under the last of them
+				run.parallel = false;
+				Node* last = parseStatements(run);
+				if (run.failed)
+					break;
+
+				if (last != nullptr)
+				{
+					run.parents.push_back(last);
+					push(A_Leave);
+					push(N_StatementsList);
+					continue;
+				}
+			}
+
+			int production = table[symbol - N_Program][token];
+
+			const char* name = nodeNames[symbol - N_Program];
+			if (name != nullptr)
+			{
+				if (run.events != nullptr)
+					run.events->enter(name);
+				else
+					run.parents.push_back(appendNode(run.parents.back(), name, 0, -1));
+				push(A_Leave);
+			}
+
+			if (production == P_None)
+			{
+				fail(name);
+				break;
+			}
+
+			if (production == P_AssignOrCall)
+			{
+				int next = 0;
+				if (run.stream != nullptr)
+				{
+					const Token* t = run.stream->streamToken(run.par.index);
+					next = t != nullptr ? t->id : 0;
+				}
+				else if (run.par.index < (int)lexer.tokens.size())
+					next = lexer.tokens[run.par.index].id;
+				production = next == 303 ? P_Assign : P_Call;
+			}
+
+			if (symbol == N_AsmIdentifier && token == T_Identifier)
+			{
+				run.asmInserts.push_back(run.par);
+				if (run.stream != nullptr)
+					run.stream->keepPosition(run.par.offset); // for the resolver
+			}
+
+			const int* rhs = productions[production];
+			int length = 0;
+			while (rhs[length] != -1)
+				length++;
+
+			for (int i = length - 1; i >= 0; i--)
+				push(rhs[i]);
+		}
+	}
+
+	// after an error the listener still gets a leave for every open nonterminal
+	if (run.events != nullptr)
+	{
+		for (auto const& e : symbols)
+		{
+			if (e.symbol != A_Leave)
+				continue;
+			for (int i = 0; i < e.count; i++)
+				run.events->leave();
+		}
+	}
+}
+
+// Parses the statements of the current list up to END on worker threads and
+// chains them into <statement-list> nodes under the current parent. A
+// statement ends with its first ';' or '$)': neither appears inside a valid
+// statement and an invalid one fails at the latest there, so every piece is
+// parsed exactly as the sequential run would parse it. Returns the last list
+// node, or nullptr when the list is too short to split or has failed.
+Node* Parser::parseStatements(TableRun& run) const
+{
+	const ChunkedList<Token>& tokens = lexer.tokens;
+
+	if (run.par.id == 0)
+		return nullptr;
+
+	// statement k is the tokens [starts[k], starts[k + 1])
+	std::vector<int> starts;
+	int i = run.par.index - 1;
+	while (i < run.end && tokens[i].id != 403)
+	{
+		starts.push_back(i);
+		while (i < run.end && tokens[i].id != 59 && tokens[i].id != 302)
+			i++;
+		if (i < run.end)
+			i++;
+	}
+	starts.push_back(i);
+
+	size_t count = starts.size() - 1;
+	size_t workers = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	workers = std::min(workers, count / std::max<size_t>(1, statementsPerThread));
+	if (workers < 2)
+		return nullptr;
+
+	struct Piece
+	{
+		Node holder; // the first list node of the piece is its only leaf
+		Node* last = nullptr;
+		std::vector<TreeParser> asmInserts;
+
+		size_t failedAt = (size_t)-1;
+		std::string error = "";
+		TreeParser par;
+	};
+
+	std::vector<Piece> pieces(workers);
+	std::atomic<size_t> firstError((size_t)-1);
+
+	auto parse = [&](size_t w)
+	{
+		Piece& piece = pieces[w];
+		Node* parent = &piece.holder;
+
+		// one run for all statements, its stacks keep their capacity
+		TableRun statement;
+		statement.symbol = N_Statement;
+		statement.parents.reserve(16);
+
+		for (size_t k = count * w / workers; k < count * (w + 1) / workers; k++)
+		{
+			// statements after an error are never reached sequentially
+			if (k > firstError.load(std::memory_order_relaxed))
+				break;
+
+			Node* list = appendNode(parent, "<statement-list>", 0, -1);
+
+			statement.par = { starts[k], 0, -1 };
+			statement.end = starts[k + 1];
+			statement.parents.assign(1, list);
+			runTable(statement);
+			parent = list;
+
+			if (statement.failed)
+			{
+				piece.failedAt = k;
+				piece.error = statement.error;
+				piece.par = statement.par;
+
+				size_t known = firstError.load();
+				while (k < known && !firstError.compare_exchange_weak(known, k))
+				{
+				}
+				break;
+			}
+		}
+
+		piece.last = parent == &piece.holder ? nullptr : parent;
+		piece.asmInserts = std::move(statement.asmInserts);
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t w = 1; w < workers; w++)
+		pool.emplace_back(parse, w);
+	parse(0);
+	for (auto& t : pool)
+		t.join();
+
+	Node* parent = run.parents.back();
+	Node* last = nullptr;
+	size_t failedAt = firstError.load();
+
+	for (auto& piece : pieces)
+	{
+		if (piece.last == nullptr)
+			continue;
+
+		parent->leaf.push_back(std::move(piece.holder.leaf[0]));
+		parent = last = piece.last;
+		run.asmInserts.insert(run.asmInserts.end(), piece.asmInserts.begin(), piece.asmInserts.end());
+
+		if (piece.failedAt != (size_t)-1 && piece.failedAt == failedAt)
+		{
+			run.failed = true;
+			run.error = piece.error;
+			run.par = piece.par;
+			break;
+		}
+	}
+
+	// pieces after the first error, their chains are as deep as they are long
+	for (auto& piece : pieces)
+	{
+		if (!piece.holder.leaf.empty() && piece.holder.leaf[0] != nullptr)
+			release(std::move(piece.holder.leaf[0]));
+	}
+
+	if (run.failed)
+		return nullptr;
+
+	// continue after the statements, as if they were read one by one
+	run.par.index = starts[count];
+	run.par.offset = tokens[starts[count] - 1].offset;
+	if (run.par.index < run.end)
+	{
+		run.par.id = tokens[run.par.index].id;
+		run.par.offset = tokens[run.par.index].offset;
+		run.par.index++;
+	}
+	else
+		run.par.id = 0;
+
+	return last;
+}
+
+Node* Parser::appendNode(Node* root, const std::string& value, int id, int offset) const
+{
+	root->leaf.push_back(std::make_shared<Node>(Node{ value, id, {}, offset }));
+	return root->leaf.back().get();
+}
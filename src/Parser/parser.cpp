@@ -1,20 +1,130 @@
 #include "parser.h"
 
 #include <iostream>
+#include <chrono>
+#include <thread>
 
 Parser::Parser(const std::string& filename) : 
-	par({0, 0, 0, 0}),
+	par({0, 0, -1}),
 	head(std::make_shared<Node>(Node{ "<signal-program>", 0, {} })),
-	current(head)
+	current(head),
+	inputFile(filename)
+{
+}
+
+Parser::Parser(const std::string& filename, const std::string& lexerOutput, const std::string& parserOutput) :
+	par({0, 0, -1}),
+	head(std::make_shared<Node>(Node{ "<signal-program>", 0, {} })),
+	current(head),
+	lexer_output_path(lexerOutput),
+	parser_output_path(parserOutput),
+	inputFile(filename)
+{
+}
+
+Parser::Parser(const SourceText& source, const std::string& lexerOutput, const std::string& parserOutput) :
+	par({0, 0, -1}),
+	head(std::make_shared<Node>(Node{ "<signal-program>", 0, {} })),
+	current(head),
+	lexer_output_path(lexerOutput),
+	parser_output_path(parserOutput),
+	inputText(source.text),
+	fromText(true)
 {
-	lexer.startLexicalAnalyzer(filename);
-	lexer.printLexicalResultsToFile(lexer_output_path);
 }
 
 Parser::~Parser()
 {
 	if (outputParser.is_open())
 		outputParser.close();
+
+	current.reset();
+	release(std::move(head));
+}
+
+// statement lists nest one level per statement, so trees are released node
+// by node instead of through recursive destructors
+void Parser::release(std::shared_ptr<Node> root)
+{
+	std::vector<std::shared_ptr<Node>> pending;
+	pending.push_back(std::move(root));
+
+	while (!pending.empty())
+	{
+		std::shared_ptr<Node> n = std::move(pending.back());
+		pending.pop_back();
+
+		for (auto& i : n->leaf)
+			pending.push_back(std::move(i));
+		n->leaf.clear();
+	}
+}
+
+void Parser::setResolver(AsmResolver* r)
+{
+	resolver = r;
+}
+
+void Parser::setEngine(ParserEngine e)
+{
+	engine = e;
+}
+
+void Parser::setThreads(unsigned int n)
+{
+	threads = n;
+}
+
+void Parser::setStatementsPerThread(size_t n)
+{
+	statementsPerThread = n;
+}
+
+void Parser::setListener(ParseListener* l)
+{
+	listener = l;
+}
+
+void Parser::setStreaming(bool s)
+{
+	streaming = s;
+}
+
+const Node* Parser::getTree() const
+{
+	return head.get();
+}
+
+const Lexer& Parser::getLexer() const
+{
+	return lexer;
+}
+
+Position Parser::getPosition(int offset) const
+{
+	return lexer.getPosition(offset);
+}
+
+bool Parser::hasErrors() const
+{
+	return !errorsParser.empty() || !lexer.errors.empty();
+}
+
+void Parser::printErrors(std::ostream& out) const
+{
+	for (auto const& i : lexer.errors)
+		out << i;
+	for (auto const& i : errorsParser)
+		out << i << std::endl;
+}
+
+std::vector<std::string> Parser::getInserts() const
+{
+	std::vector<std::string> names;
+	for (auto const& i : asmInserts)
+		names.push_back(findInTable(i.id));
+
+	return names;
 }
 
 void Parser::nextToken()
@@ -22,17 +132,20 @@ void Parser::nextToken()
 	if (par.index < lexer.tokens.size() && doContinue)
 	{
 		par.id = lexer.tokens[par.index].id;
-		par.row = lexer.tokens[par.index].row;
-		par.col = lexer.tokens[par.index].col;
+		par.offset = lexer.tokens[par.index].offset;
 		par.index++;
 	}
+	else if (doContinue)
+	{
+		par.id = 0; // end of tokens, keeps the position of the last one
+	}
 }
 
 void Parser::addNode(Node* root)
 {
 	if (doContinue)
 	{
-		std::shared_ptr<Node> n = std::make_shared<Node> (Node{ findInTable(par.id), par.id, {} });
+		std::shared_ptr<Node> n = std::make_shared<Node> (Node{ findInTable(par.id), par.id, {}, par.offset });
 		root->leaf.push_back(n);
 		current = n;
 	}	
@@ -48,20 +161,31 @@ void Parser::addNode(Node* root, const std::string& value)
 	}
 }
 
-void Parser::printTreeToConsole(const Node* n, int depth)
+// walks a built tree as if it was parsed with a listener
+void Parser::replay(const Node* root, ParseListener& out) const
 {
-	for (int i = 0; i < depth; i++)
-	{
-		outputParser << "|  ";
-	}
+	std::vector<const Node*> pending = { root }; // nullptr leaves a nonterminal
 
-	if (n->id != 0)
-		outputParser << n->id << " ";
-	outputParser << n->value << std::endl;
-
-	for (int i = 0; i < n->leaf.size(); i++)
+	while (!pending.empty())
 	{
-		printTreeToConsole(n->leaf[i].get(), depth + 1);
+		const Node* n = pending.back();
+		pending.pop_back();
+
+		if (n == nullptr)
+		{
+			out.leave();
+		}
+		else if (n->id != 0 || n->value == "<empty>")
+		{
+			out.terminal(n->id, n->value, n->offset);
+		}
+		else
+		{
+			out.enter(n->value);
+			pending.push_back(nullptr);
+			for (auto i = n->leaf.rbegin(); i != n->leaf.rend(); ++i)
+				pending.push_back(i->get());
+		}
 	}
 }
 
@@ -79,9 +203,9 @@ std::string Parser::findInTable(int lexId) const
 	else if (lexId <= 500)
 		value = findByKey(lexer.keywords, lexId);
 	else if (lexId <= 1000)
-		value = findByKey(lexer.constants, lexId);
+		value = findById(lexer.constantsById, 501, lexId);
 	else
-		value = findByKey(lexer.identifiers, lexId);
+		value = findById(lexer.identifiersById, 1001, lexId);
 
 	return value;
 }
@@ -97,21 +221,129 @@ std::string Parser::findByKey(const std::unordered_map<std::string, int>& map, i
 	return "";
 }
 
+std::string Parser::findById(const std::vector<std::string>& table, int firstId, int val) const
+{
+	if (val < firstId || val - firstId >= (int)table.size())
+		return "";
+
+	return table[val - firstId];
+}
+
+void Parser::setScanLevel(ScanLevel level)
+{
+	lexer.setScanLevel(level);
+}
+
+// the source is lexed when parsing starts, so the scan level can still be set
+void Parser::lex()
+{
+	{
+		PhaseScope scope(Phase::Lexer);
+		if (fromText)
+			lexer.analyzeSource(std::move(inputText));
+		else if (streamed)
+		{
+			// the parser lexes the file as it goes, the output is finished afterwards
+			lexer.openStream(inputFile, lexer_output_path);
+			return;
+		}
+		else
+			lexer.startLexicalAnalyzer(inputFile);
+	}
+
+	PhaseScope scope(Phase::LexerOutput);
+	lexer.printLexicalResultsToFile(lexer_output_path);
+}
+
 void Parser::startParsing()
 {
+	streamed = !fromText && (streaming || listener != nullptr) && engine == ParserEngine::Table;
+	lex();
+
 	outputParser.open(parser_output_path);
 
-	program();
-	printTreeToConsole(head.get(), 0);
+	TreePrinter printer(outputParser);
+	events = listener;
+	if (events == nullptr && streaming && outputParser.is_open())
+		events = &printer;
 
-	for (auto const& i : errorsParser)
 	{
-		outputParser << i << std::endl;
+		// a streamed printer or listener runs inside the parser phase
+		PhaseScope scope(Phase::Parser);
+
+		if (engine == ParserEngine::Parallel)
+		{
+			// the workers build subtrees, a listener gets the whole tree afterwards
+			ParseListener* out = events;
+			events = nullptr;
+
+			parseTable();
+
+			if (out != nullptr)
+				replay(head.get(), *out);
+		}
+		else if (engine == ParserEngine::Table)
+		{
+			if (events != nullptr)
+				events->enter(head->value);
+
+			parseTable();
+
+			if (events != nullptr)
+				events->leave();
+		}
+		else
+		{
+			program();
+
+			if (events != nullptr)
+				replay(head.get(), *events);
+		}
+
+		events = nullptr;
+
+		if (resolver != nullptr)
+			resolveInserts();
 	}
 
-	outputParser.close();
+	if (streamed)
+	{
+		PhaseScope scope(Phase::LexerOutput);
+		lexer.closeStream();
+	}
+
+	PhaseScope scope(Phase::ParserOutput);
+	if (outputParser.is_open())
+	{
+		if (listener == nullptr && !streaming)
+			replay(head.get(), printer);
+
+		for (auto const& i : errorsParser)
+		{
+			outputParser << i << std::endl;
+		}
+
+		outputParser.close();
 
-	std::cout << "Parser Results were printed in: \"" << parser_output_path << "\"" << std::endl;
+		std::cout << "Parser Results were printed in: \"" << parser_output_path << "\"" << std::endl;
+	}
+}
+
+void Parser::resolveInserts()
+{
+	for (auto const& i : asmInserts)
+	{
+		std::string name = findInTable(i.id);
+
+		if (resolver->resolve(name) == nullptr)
+		{
+			Position p = lexer.getPosition(i.offset);
+
+			std::string& err = errorsParser.append();
+			err = "Resolver: Error (Line " + std::to_string(p.row) + ", Column " + std::to_string(p.col) + "): ";
+			err += "assembly insert file '" + name + "' not found.";
+		}
+	}
 }
 
 void Parser::program()
@@ -431,7 +663,7 @@ void Parser::actualArgs_list()
 
 		nextToken();
 		current = n;
-		if (par.id != 41) // )
+		if (par.id != 41 && doContinue) // )
 		{
 			actualArgs_list();
 			current = n;
@@ -472,6 +704,10 @@ void Parser::var_identifier()
 void Parser::asmIF_identifier()
 {
 	addNode(current.get(), "<assembly-insert-file-identifier>");
+
+	if (par.id >= 1001 && doContinue)
+		asmInserts.push_back(par);
+
 	identifier();
 }
 
@@ -490,10 +726,125 @@ void Parser::showError(const std::string& err)
 {
 	if (doContinue)
 	{
-		std::string err_tmp = "Parser: Error (Line " + std::to_string(par.row) + ", Column " + std::to_string(par.col) + "): ";
-		err_tmp += err + " expected.";
-
-		errorsParser.push_back(err_tmp);
+		Position p;
+		if (par.offset >= 0)
+			p = lexer.getPosition(par.offset);
+
+		std::string& err_tmp = errorsParser.append();
+		err_tmp = "Parser: Error (Line ";
+		err_tmp += std::to_string(p.row);
+		err_tmp += ", Column ";
+		err_tmp += std::to_string(p.col);
+		err_tmp += "): ";
+		err_tmp += err;
+		err_tmp += " expected.";
 	}
 	doContinue = false;
 }
+
+TreePrinter::TreePrinter(std::ostream& out) : output(out)
+{
+}
+
+void TreePrinter::enter(const std::string& name)
+{
+	line(0, name);
+	depth++;
+}
+
+void TreePrinter::leave()
+{
+	depth--;
+}
+
+void TreePrinter::terminal(int id, const std::string& value, int)
+{
+	line(id, value);
+}
+
+void TreePrinter::line(int id, const std::string& value)
+{
+	for (int i = 0; i < depth; i++)
+		output << "|  ";
+
+	if (id != 0)
+		output << id << " ";
+	output << value << '\n';
+}
+
+void benchmarkParsers(const std::string& filename, unsigned int threads)
+{
+	const char* names[] = { "recursive descent", "table", "parallel" };
+	ParserEngine engines[] = { ParserEngine::RecursiveDescent, ParserEngine::Table, ParserEngine::Parallel };
+	double best[3] = { -1, -1, -1 };
+
+	for (int run = 0; run < 5; run++)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			Parser par(filename, "", "");
+			par.setEngine(engines[e]);
+			par.setThreads(threads);
+
+			auto start = std::chrono::steady_clock::now();
+			par.startParsing();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			if (best[e] < 0 || elapsed.count() < best[e])
+				best[e] = elapsed.count();
+		}
+	}
+
+	for (int e = 0; e < 3; e++)
+		std::cout << names[e] << ":\t" << best[e] * 1000 << " ms" << std::endl;
+	std::cout << "speedup:\tx" << best[0] / best[1] << std::endl;
+	std::cout << "parallel speedup:\tx" << best[1] / best[2] << " on "
+		<< (threads != 0 ? threads : std::thread::hardware_concurrency()) << " threads" << std::endl;
+}
+
+// chunk allocations of the token and diagnostic pools, and all heap
+// allocations in a build that counts them, over a batch of compilations
+void benchmarkStorage(const std::string& filename, size_t files)
+{
+	auto allocated = []()
+	{
+		return ChunkedList<Token>::Pool::shared().allocatedChunks()
+			+ ChunkedList<std::string, 256>::Pool::shared().allocatedChunks();
+	};
+
+	size_t before = allocated();
+	size_t first = 0;
+#ifdef COUNT_ALLOCATIONS
+	size_t heapBefore = heapAllocations();
+	size_t heapFirst = 0;
+#endif
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < files; i++)
+	{
+		Parser par(filename, "", "");
+		par.startParsing();
+
+		if (i == 0)
+		{
+			first = allocated() - before;
+#ifdef COUNT_ALLOCATIONS
+			heapFirst = heapAllocations() - heapBefore;
+#endif
+		}
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << "files:\t" << files << std::endl;
+	std::cout << "chunks allocated by the first file:\t" << first << std::endl;
+	std::cout << "chunks allocated by the other files:\t" << allocated() - before - first << std::endl;
+#ifdef COUNT_ALLOCATIONS
+	size_t heapOthers = heapAllocations() - heapBefore - heapFirst;
+	std::cout << "heap allocations by the first file:\t" << heapFirst << std::endl;
+	if (files > 1)
+		std::cout << "heap allocations per other file:\t" << (double)heapOthers / (files - 1) << std::endl;
+#else
+	std::cout << "heap allocations:\tnot counted, build with COUNT_ALLOCATIONS defined" << std::endl;
+#endif
+	std::cout << "time:\t" << elapsed.count() * 1000 << " ms" << std::endl;
+}
@@ -1,16 +1,56 @@
 #pragma once
 
 #include "../Lexer/lexer.h"
+#include "../Resolver/resolver.h"
+#include "../Profile/profile.h"
 
 #include <fstream>
 #include <vector>
-#include <list>
+#include <memory>
+
+enum class ParserEngine
+{
+	RecursiveDescent,
+	Table,
+	Parallel // table-driven, the statements of long programs on worker threads
+};
 
 struct Node
 {
 	std::string value = "";
 	int id = -1;
 	std::vector<std::shared_ptr<Node>> leaf;
+	int offset = -1; // source offset of token nodes
+};
+
+// Receives the tree in document order while it is parsed, so consumers
+// don't need the whole tree in memory
+class ParseListener
+{
+public:
+	virtual ~ParseListener() {}
+
+	virtual void enter(const std::string&) = 0; // nonterminal
+	virtual void leave() = 0;
+	virtual void terminal(int, const std::string&, int) = 0; // id, value, source offset
+};
+
+// Tree listing of outputPar.txt
+class TreePrinter : public ParseListener
+{
+private:
+	std::ostream& output;
+	int depth = 0;
+
+public:
+	TreePrinter(std::ostream&);
+
+	void enter(const std::string&) override;
+	void leave() override;
+	void terminal(int, const std::string&, int) override;
+
+private:
+	void line(int, const std::string&);
 };
 
 class Parser
@@ -20,18 +60,45 @@ private:
 	{
 		int index = 0;
 		int id = 0;
-		int row = 0;
-		int col = 0;
+		int offset = -1;
 	};
 
 	TreeParser par;
 
+	// one pass of the LL(1) parser over the tokens [par.index, end), see ll1.cpp
+	struct TableRun
+	{
+		TreeParser par;
+		int end = 0;
+		int symbol = 0; // start symbol
+		ParseListener* events = nullptr;
+		std::vector<Node*> parents; // only without a listener
+		bool parallel = false; // the top-level statement list goes to worker threads
+		Lexer* stream = nullptr; // tokens come from the lexer batch by batch
+
+		// statement lists nest one level per statement, so repeated A_Leave
+		// entries are counted instead of stored
+		struct Entry
+		{
+			int symbol;
+			int count;
+		};
+		std::vector<Entry> symbols;
+
+		std::vector<TreeParser> asmInserts;
+		bool failed = false;
+		std::string error = ""; // "<x>" of "<x> expected."
+	};
+
 	Lexer lexer;
 
 	std::shared_ptr<Node> head;
 	std::shared_ptr<Node> current;
 
-	std::list<std::string> errorsParser;
+	ChunkedList<std::string, 256> errorsParser;
+
+	std::vector<TreeParser> asmInserts;
+	AsmResolver* resolver = nullptr;
 
 	std::ofstream outputParser;
 
@@ -40,20 +107,67 @@ private:
 
 	bool doContinue = true;
 
+	// lexed by startParsing()
+	std::string inputFile = "";
+	std::string inputText = "";
+	bool fromText = false;
+
+	ParserEngine engine = ParserEngine::Table;
+	unsigned int threads = 0; // parallel engine, 0 is one per core
+	size_t statementsPerThread = 4096; // shorter programs are parsed sequentially
+
+	ParseListener* listener = nullptr;
+	ParseListener* events = nullptr; // listener of the running parse
+	bool streaming = false;
+	bool streamed = false; // the table engine takes tokens while the file is lexed
+
 public:
 	Parser(const std::string&);
+	Parser(const std::string&, const std::string&, const std::string&);
+	Parser(const SourceText&, const std::string&, const std::string&);
 	~Parser();
 
+	void setResolver(AsmResolver*);
+	void setEngine(ParserEngine);
+	void setThreads(unsigned int);
+	void setScanLevel(ScanLevel);
+	void setStatementsPerThread(size_t);
+
+	// events go to the listener instead of a tree, the parser output only gets the errors
+	void setListener(ParseListener*);
+	// the parser output is printed while parsing, without building a tree; with
+	// the table engine the file is also lexed while parsing, so memory doesn't
+	// grow with the program, and afterwards getPosition() only knows the
+	// positions of errors and assembly inserts
+	void setStreaming(bool);
+
 	void startParsing();
 
+	const Node* getTree() const;
+	const Lexer& getLexer() const;
+	Position getPosition(int) const;
+	bool hasErrors() const;
+	void printErrors(std::ostream&) const; // lexer errors, then parser errors
+	std::vector<std::string> getInserts() const; // "($ NAME $)" names
+
 private:
+	void lex();
 	void nextToken();
 	std::string findInTable(int) const;
 	std::string findByKey(const std::unordered_map<std::string, int>&, int) const;
+	std::string findById(const std::vector<std::string>&, int, int) const;
+
+	void resolveInserts();
 
 	void addNode(Node*);
 	void addNode(Node*, const std::string&);
-	void printTreeToConsole(const Node*, int);
+	void replay(const Node*, ParseListener&) const;
+
+	void parseTable();
+	void runTable(TableRun&) const;
+	Node* parseStatements(TableRun&) const;
+	Node* appendNode(Node*, const std::string&, int, int) const;
+	static void release(std::shared_ptr<Node>);
 
 	void program();
 	void block();
@@ -69,3 +183,8 @@ private:
 
 	void showError(const std::string&);
 };
+
+// parse time of both engines on one file
+void benchmarkParsers(const std::string&, unsigned int);
+// parses the file the given number of times and reports pool allocations
+void benchmarkStorage(const std::string&, size_t);
@@ -0,0 +1,148 @@
+#include "pipe.h"
+
+#include <iostream>
+#include <chrono>
+
+static bool isWordCharacter(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+void ProgramSplitter::endWord()
+{
+	if (word.empty())
+		return;
+
+	if (lastWord == "PROGRAM" && name.empty())
+		name = word;
+
+	afterEnd = word == "END";
+	lastWord = std::move(word);
+	word.clear();
+}
+
+size_t ProgramSplitter::feed(const std::string& chunk, size_t from)
+{
+	for (size_t i = from; i < chunk.size(); i++)
+	{
+		char c = chunk[i];
+		unit += c;
+
+		if (c == '\n')
+			line++;
+
+		if (inComment)
+		{
+			if (previous == '*' && c == ')')
+			{
+				inComment = false;
+				c = 0;
+			}
+			previous = c;
+			continue;
+		}
+
+		if (previous == '(' && c == '*')
+		{
+			// the star that opens a comment can't close it
+			inComment = true;
+			previous = 0;
+			continue;
+		}
+		previous = c;
+
+		if (isWordCharacter(c))
+		{
+			word += c;
+			hasCode = true;
+			continue;
+		}
+		endWord();
+
+		if (c == ' ' || (c >= 8 && c <= 13) || c == '(')
+			continue;
+
+		hasCode = true;
+		if (c == ';' && afterEnd)
+			return i + 1;
+
+		afterEnd = false;
+	}
+
+	return std::string::npos;
+}
+
+void ProgramSplitter::next()
+{
+	unit.clear();
+	unitLine = line;
+	name.clear();
+
+	inComment = false;
+	previous = 0;
+	word.clear();
+	lastWord.clear();
+	afterEnd = false;
+	hasCode = false;
+}
+
+bool compileStream(std::istream& in, AsmResolver* resolver, ParserEngine engine)
+{
+	ProgramSplitter splitter;
+	size_t programs = 0;
+	size_t failed = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	auto compile = [&]()
+	{
+		if (Profiler::current() != nullptr)
+			Profiler::current()->beginFile("stdin " + std::to_string(programs + 1));
+
+		Parser par(SourceText{ splitter.text() }, "", "");
+		par.setResolver(resolver);
+		par.setEngine(engine);
+		par.startParsing();
+
+		programs++;
+		bool errors = par.hasErrors();
+		if (errors)
+			failed++;
+
+		std::cout << "Stdin: program " << programs << " '" << splitter.programName()
+			<< "' (line " << splitter.startLine() << "): " << (errors ? "errors" : "ok") << std::endl;
+		par.printErrors(std::cout);
+		std::cout.flush();
+
+		splitter.next();
+	};
+
+	// units end at line ends or in the middle of a line, whatever the pipe delivers
+	std::string line;
+	while (std::getline(in, line))
+	{
+		line += '\n';
+
+		size_t from = 0;
+		while (from < line.size())
+		{
+			size_t end = splitter.feed(line, from);
+			if (end == std::string::npos)
+				break;
+
+			compile();
+			from = end;
+		}
+	}
+
+	// a program without END; still gets its diagnostics
+	if (!splitter.empty())
+		compile();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Stdin: " << programs << " programs, " << failed << " with errors, "
+		<< elapsed.count() * 1000 << " ms, " << (elapsed.count() > 0 ? programs / elapsed.count() : 0)
+		<< " programs/s" << std::endl;
+
+	return failed == 0;
+}
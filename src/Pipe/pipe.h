@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../Parser/parser.h"
+
+#include <string>
+#include <istream>
+
+// Cuts a stream of concatenated programs into compilation units. A unit
+// ends with the ";" after END; comments are skipped, so "END;" inside a
+// comment does not end a unit.
+class ProgramSplitter
+{
+private:
+	std::string unit;
+	int unitLine = 1; // line of the stream where the unit starts
+	int line = 1;
+	std::string name; // identifier after PROGRAM
+
+	bool inComment = false;
+	char previous = 0;
+	std::string word;
+	std::string lastWord;
+	bool afterEnd = false; // END was the last word, only ";" may end the unit
+	bool hasCode = false; // anything besides whitespace and comments
+
+public:
+	// adds the text from the position on, returns the position after the end
+	// of the unit or npos when the unit goes on
+	size_t feed(const std::string&, size_t);
+
+	const std::string& text() const { return unit; }
+	const std::string& programName() const { return name; }
+	int startLine() const { return unitLine; }
+	bool empty() const { return !hasCode; }
+
+	// starts the next unit
+	void next();
+
+private:
+	void endWord();
+};
+
+// compiles every program read from the stream and reports each one as soon as
+// it is parsed, then the throughput; false when any program has errors
+bool compileStream(std::istream&, AsmResolver*, ParserEngine);
@@ -0,0 +1,224 @@
+#include "profile.h"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static thread_local Profiler* currentProfiler = nullptr;
+
+static const char* phaseNames[] = { "lexer", "lexer output", "parser", "parser output" };
+static const char* counterNames[] = { "cycles", "instructions", "branch misses", "cache misses" };
+
+#ifdef __linux__
+
+static int openCounter(unsigned long long config, int group)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = group < 0 ? 1 : 0; // the group starts with its leader
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+Profiler::Profiler()
+{
+	descriptors.fill(-1);
+
+	const unsigned long long configs[] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_MISSES
+	};
+
+	// one group, so the counters are scheduled together and read with one call
+	leader = openCounter(configs[0], -1);
+	if (leader < 0)
+	{
+		unavailable = std::strerror(errno);
+		return;
+	}
+	descriptors[0] = leader;
+
+	for (size_t i = 1; i < (size_t)Counter::Count; i++)
+		descriptors[i] = openCounter(configs[i], leader);
+
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+Profiler::~Profiler()
+{
+	if (currentProfiler == this)
+		currentProfiler = nullptr;
+
+	for (int fd : descriptors)
+	{
+		if (fd >= 0)
+			close(fd);
+	}
+}
+
+bool Profiler::read(std::array<unsigned long long, (size_t)Counter::Count>& values) const
+{
+	if (leader < 0)
+		return false;
+
+	// nr, then a value and an id for every counter of the group
+	unsigned long long buffer[1 + 2 * (size_t)Counter::Count];
+	if (::read(leader, buffer, sizeof(buffer)) <= 0)
+		return false;
+
+	size_t slot = 0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		if (descriptors[i] >= 0 && slot < buffer[0])
+			values[i] = buffer[1 + 2 * slot++];
+		else
+			values[i] = 0;
+	}
+
+	return true;
+}
+
+#else
+
+Profiler::Profiler()
+{
+	descriptors.fill(-1);
+	unavailable = "perf_event_open needs Linux";
+}
+
+Profiler::~Profiler()
+{
+	if (currentProfiler == this)
+		currentProfiler = nullptr;
+}
+
+bool Profiler::read(std::array<unsigned long long, (size_t)Counter::Count>&) const
+{
+	return false;
+}
+
+#endif
+
+void Profiler::setCurrent(Profiler* p)
+{
+	currentProfiler = p;
+}
+
+Profiler* Profiler::current()
+{
+	return currentProfiler;
+}
+
+void Profiler::beginFile(const std::string& filename)
+{
+	FileProfile f;
+	f.filename = filename;
+	files.push_back(f);
+}
+
+void Profiler::add(Phase phase, const PhaseSample& sample)
+{
+	if (files.empty())
+		beginFile("");
+
+	PhaseSample& total = files.back().phases[(size_t)phase];
+	total.seconds += sample.seconds;
+	for (size_t i = 0; i < sample.counters.size(); i++)
+		total.counters[i] += sample.counters[i];
+}
+
+static void printSample(const std::string& file, const char* phase, const PhaseSample& s, const Profiler& p)
+{
+	std::cout << file << "\t" << phase << "\t" << s.seconds * 1000;
+
+	for (size_t i = 0; i < (size_t)Counter::Count; i++)
+	{
+		std::cout << "\t";
+		if (p.available((Counter)i))
+			std::cout << s.counters[i];
+		else
+			std::cout << "-";
+	}
+
+	unsigned long long cycles = s.counters[(size_t)Counter::Cycles];
+	std::cout << "\t";
+	if (p.available(Counter::Cycles) && p.available(Counter::Instructions) && cycles > 0)
+		std::cout << (double)s.counters[(size_t)Counter::Instructions] / cycles;
+	else
+		std::cout << "-";
+	std::cout << std::endl;
+}
+
+void Profiler::print() const
+{
+	if (!unavailable.empty())
+		std::cout << "Profile: hardware counters unavailable (" << unavailable << "), only time is reported" << std::endl;
+
+	std::cout << "file\tphase\tms";
+	for (auto name : counterNames)
+		std::cout << "\t" << name;
+	std::cout << "\tIPC" << std::endl;
+
+	std::array<PhaseSample, (size_t)Phase::Count> totals;
+	for (auto const& f : files)
+	{
+		for (size_t phase = 0; phase < (size_t)Phase::Count; phase++)
+		{
+			const PhaseSample& s = f.phases[phase];
+			printSample(f.filename, phaseNames[phase], s, *this);
+
+			totals[phase].seconds += s.seconds;
+			for (size_t i = 0; i < s.counters.size(); i++)
+				totals[phase].counters[i] += s.counters[i];
+		}
+	}
+
+	if (files.size() > 1)
+	{
+		for (size_t phase = 0; phase < (size_t)Phase::Count; phase++)
+			printSample("total", phaseNames[phase], totals[phase], *this);
+	}
+}
+
+PhaseScope::PhaseScope(Phase p) : profiler(Profiler::current()), phase(p), counters()
+{
+	if (profiler == nullptr)
+		return;
+
+	if (!profiler->read(counters))
+		counters.fill(0);
+	start = std::chrono::steady_clock::now();
+}
+
+PhaseScope::~PhaseScope()
+{
+	if (profiler == nullptr)
+		return;
+
+	PhaseSample sample;
+	sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::array<unsigned long long, (size_t)Counter::Count> end;
+	if (profiler->read(end))
+	{
+		for (size_t i = 0; i < end.size(); i++)
+			sample.counters[i] = end[i] - counters[i];
+	}
+
+	profiler->add(phase, sample);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+
+enum class Phase
+{
+	Lexer,
+	LexerOutput, // token and lexeme tables
+	Parser,
+	ParserOutput, // tree printer and diagnostics
+	Count
+};
+
+enum class Counter
+{
+	Cycles,
+	Instructions,
+	BranchMisses,
+	CacheMisses,
+	Count
+};
+
+struct PhaseSample
+{
+	double seconds = 0;
+	std::array<unsigned long long, (size_t)Counter::Count> counters = {};
+};
+
+// Hardware counters of the calling thread through perf_event_open, read
+// around every compiler phase. When the kernel refuses the counters (no
+// permission, containers, other systems) only the time is recorded.
+class Profiler
+{
+private:
+	struct FileProfile
+	{
+		std::string filename;
+		std::array<PhaseSample, (size_t)Phase::Count> phases;
+	};
+
+	std::array<int, (size_t)Counter::Count> descriptors;
+	int leader = -1;
+	std::string unavailable = ""; // why counters are missing
+
+	std::vector<FileProfile> files;
+
+public:
+	Profiler();
+	~Profiler();
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// phases of the thread are recorded into this profiler, nullptr stops it
+	static void setCurrent(Profiler*);
+	static Profiler* current();
+
+	// following phases belong to this file
+	void beginFile(const std::string&);
+
+	bool available(Counter c) const { return descriptors[(size_t)c] >= 0; }
+
+	// per file and phase, then totals per phase
+	void print() const;
+
+private:
+	friend class PhaseScope;
+
+	bool read(std::array<unsigned long long, (size_t)Counter::Count>&) const;
+	void add(Phase, const PhaseSample&);
+};
+
+// records the enclosing block as a phase of the current profiler, if any
+class PhaseScope
+{
+private:
+	Profiler* profiler;
+	Phase phase;
+	std::chrono::steady_clock::time_point start;
+	std::array<unsigned long long, (size_t)Counter::Count> counters;
+
+public:
+	PhaseScope(Phase);
+	~PhaseScope();
+};
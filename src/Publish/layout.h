@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary layout of a compilation published in a POSIX shared memory object
+// (publish.h), read in place by PublishedResults (reader.h).
+//
+// The object starts with a PublishedHeader. Each section it lists is an
+// array of records of the given size, 8-byte aligned; readers step by that
+// size, so a minor version may append fields to a record. A major version
+// changes the meaning of existing fields. All integers are in the byte
+// order of the machine that compiled, strings are (offset, length) pairs
+// into the Strings section, and every string is followed by a 0 byte.
+//
+//   Strings      bytes
+//   Tokens       PublishedToken in source order (outputLex.txt "Lexemes")
+//   Constants    PublishedSymbol by id from 501 (outputLex.txt "Constants")
+//   Identifiers  PublishedSymbol by id from 1001 (outputLex.txt "Identifiers")
+//   Nodes        PublishedNode, the tree in preorder (outputPar.txt)
+//   Diagnostics  PublishedDiagnostic, lexer errors, then parser errors
+//
+// The writer creates a new object, fills it and stores the magic last, so a
+// reader that finds no magic is looking at an unfinished object. Readers
+// that mapped an earlier object of the same name keep it until they unmap.
+
+const uint32_t PublishedMagic = 0x53524753; // "SGRS"
+const uint16_t PublishedMajor = 1;
+const uint16_t PublishedMinor = 0;
+
+enum PublishedSectionKind
+{
+	PublishedStrings = 0,
+	PublishedTokens = 1,
+	PublishedConstants = 2,
+	PublishedIdentifiers = 3,
+	PublishedNodes = 4,
+	PublishedDiagnostics = 5,
+	PublishedSectionCount = 6
+};
+
+enum PublishedFlags
+{
+	PublishedLexerErrors = 1,
+	PublishedParserErrors = 2
+};
+
+struct PublishedSection
+{
+	uint64_t offset; // from the start of the object
+	uint64_t count; // records
+	uint32_t recordSize;
+	uint32_t reserved;
+};
+
+struct PublishedHeader
+{
+	uint32_t magic;
+	uint16_t major;
+	uint16_t minor;
+	uint64_t size; // bytes of the whole object
+	uint32_t flags; // PublishedFlags
+	uint32_t sectionCount; // entries of sections, later minor versions add more after them
+	PublishedSection sections[PublishedSectionCount];
+};
+
+struct PublishedString
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct PublishedToken
+{
+	int32_t offset; // byte offset in the source
+	int32_t row;
+	int32_t col;
+	int32_t id;
+	PublishedString value;
+};
+
+struct PublishedSymbol
+{
+	int32_t id;
+	uint32_t reserved;
+	PublishedString lexeme;
+};
+
+// Nonterminals and <empty> have id 0. The subtree of a node ends before the
+// node at index end.
+struct PublishedNode
+{
+	PublishedString value;
+	int32_t id;
+	int32_t offset; // byte offset in the source of terminals, -1 otherwise
+	uint32_t end;
+	uint32_t depth; // 0 for <signal-program>
+};
+
+struct PublishedDiagnostic
+{
+	uint32_t parser; // 0 for lexer errors (outputLex.txt), 1 for parser and resolver errors (outputPar.txt)
+	uint32_t reserved;
+	PublishedString message;
+};
+
+static_assert(sizeof(PublishedSection) == 24, "PublishedSection layout");
+static_assert(sizeof(PublishedHeader) == 24 + 24 * PublishedSectionCount, "PublishedHeader layout");
+static_assert(sizeof(PublishedToken) == 24, "PublishedToken layout");
+static_assert(sizeof(PublishedSymbol) == 16, "PublishedSymbol layout");
+static_assert(sizeof(PublishedNode) == 24, "PublishedNode layout");
+static_assert(sizeof(PublishedDiagnostic) == 16, "PublishedDiagnostic layout");
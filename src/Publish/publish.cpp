@@ -0,0 +1,423 @@
+#include "publish.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// the Strings section, every distinct string once
+class PublishedStringTable
+{
+private:
+	std::string bytes;
+	std::unordered_map<std::string, PublishedString> added;
+
+public:
+	PublishedString add(const std::string& s)
+	{
+		auto i = added.find(s);
+		if (i != added.end())
+			return i->second;
+
+		PublishedString result = { (uint32_t)bytes.size(), (uint32_t)s.size() };
+		bytes += s;
+		bytes += '\0';
+		added.emplace(s, result);
+		return result;
+	}
+
+	const std::string& data() const { return bytes; }
+};
+
+static std::vector<PublishedSymbol> publishedSymbols(const std::vector<std::string>& byId, int first, PublishedStringTable& strings)
+{
+	std::vector<PublishedSymbol> symbols;
+	symbols.reserve(byId.size());
+
+	for (size_t i = 0; i < byId.size(); i++)
+		symbols.push_back({ first + (int32_t)i, 0, strings.add(byId[i]) });
+
+	return symbols;
+}
+
+// preorder with explicit stacks, statement lists nest as deep as the program is long
+static std::vector<PublishedNode> publishedTree(const Node* root, PublishedStringTable& strings)
+{
+	std::vector<PublishedNode> nodes;
+	if (root == nullptr)
+		return nodes;
+
+	struct Pending
+	{
+		const Node* node; // nullptr ends the subtree of the node at index
+		uint32_t index;
+		uint32_t depth;
+	};
+	std::vector<Pending> pending = { { root, 0, 0 } };
+
+	while (!pending.empty())
+	{
+		Pending p = pending.back();
+		pending.pop_back();
+
+		if (p.node == nullptr)
+		{
+			nodes[p.index].end = (uint32_t)nodes.size();
+			continue;
+		}
+
+		uint32_t index = (uint32_t)nodes.size();
+		nodes.push_back({ strings.add(p.node->value), p.node->id, p.node->offset, index + 1, p.depth });
+
+		if (!p.node->leaf.empty())
+		{
+			pending.push_back({ nullptr, index, 0 });
+			for (auto i = p.node->leaf.rbegin(); i != p.node->leaf.rend(); ++i)
+				pending.push_back({ i->get(), 0, p.depth + 1 });
+		}
+	}
+
+	return nodes;
+}
+
+bool publishResults(const std::string& name, const Parser& par, std::string& error)
+{
+#ifndef _WIN32
+	const Lexer& lexer = par.getLexer();
+	PublishedStringTable strings;
+
+	std::vector<PublishedToken> tokens;
+	tokens.reserve(lexer.tokens.size());
+	for (auto const& t : lexer.tokens)
+	{
+		Position p = lexer.getPosition(t.offset);
+		tokens.push_back({ t.offset, p.row, p.col, t.id, strings.add(t.value) });
+	}
+
+	std::vector<PublishedSymbol> constants = publishedSymbols(lexer.constantsById, 501, strings);
+	std::vector<PublishedSymbol> identifiers = publishedSymbols(lexer.identifiersById, 1001, strings);
+	std::vector<PublishedNode> nodes = publishedTree(par.getTree(), strings);
+
+	// one line each, lexer errors come first
+	std::vector<PublishedDiagnostic> diagnostics;
+	std::ostringstream errors;
+	par.printErrors(errors);
+	std::istringstream lines(errors.str());
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		uint32_t parser = diagnostics.size() >= lexer.errors.size() ? 1 : 0;
+		diagnostics.push_back({ parser, 0, strings.add(line) });
+	}
+
+	PublishedHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.major = PublishedMajor;
+	header.minor = PublishedMinor;
+	header.sectionCount = PublishedSectionCount;
+	if (!lexer.errors.empty())
+		header.flags |= PublishedLexerErrors;
+	if (diagnostics.size() > lexer.errors.size())
+		header.flags |= PublishedParserErrors;
+
+	const void* data[PublishedSectionCount] = {
+		strings.data().data(), tokens.data(), constants.data(), identifiers.data(), nodes.data(), diagnostics.data()
+	};
+	size_t counts[PublishedSectionCount] = {
+		strings.data().size(), tokens.size(), constants.size(), identifiers.size(), nodes.size(), diagnostics.size()
+	};
+	size_t recordSizes[PublishedSectionCount] = {
+		1, sizeof(PublishedToken), sizeof(PublishedSymbol), sizeof(PublishedSymbol), sizeof(PublishedNode), sizeof(PublishedDiagnostic)
+	};
+
+	uint64_t size = sizeof(PublishedHeader);
+	for (int i = 0; i < PublishedSectionCount; i++)
+	{
+		size = (size + 7) & ~(uint64_t)7;
+		header.sections[i] = { size, counts[i], (uint32_t)recordSizes[i], 0 };
+		size += counts[i] * recordSizes[i];
+	}
+	header.size = size;
+
+	// a new object, so readers of the old one keep what they mapped
+	std::string object = publishedObjectName(name);
+	shm_unlink(object.c_str());
+
+	int descriptor = shm_open(object.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (descriptor < 0)
+	{
+		error = "Can't create " + object;
+		return false;
+	}
+
+	if (ftruncate(descriptor, (off_t)size) != 0)
+	{
+		::close(descriptor);
+		shm_unlink(object.c_str());
+		error = "Can't allocate " + std::to_string(size) + " bytes for " + object;
+		return false;
+	}
+
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (memory == MAP_FAILED)
+	{
+		shm_unlink(object.c_str());
+		error = "Can't map " + object;
+		return false;
+	}
+
+	unsigned char* bytes = (unsigned char*)memory;
+	for (int i = 0; i < PublishedSectionCount; i++)
+	{
+		if (counts[i] > 0)
+			std::memcpy(bytes + header.sections[i].offset, data[i], counts[i] * recordSizes[i]);
+	}
+
+	// the magic goes last, readers check it before anything else
+	std::memcpy(bytes, &header, sizeof(header));
+	__atomic_store_n((uint32_t*)bytes, PublishedMagic, __ATOMIC_RELEASE);
+
+	munmap(memory, size);
+	return true;
+#else
+	(void)name;
+	(void)par;
+	error = "Shared memory is not supported on this system";
+	return false;
+#endif
+}
+
+bool unpublishResults(const std::string& name)
+{
+#ifndef _WIN32
+	return shm_unlink(publishedObjectName(name).c_str()) == 0;
+#else
+	(void)name;
+	return false;
+#endif
+}
+
+bool showPublished(const std::string& name)
+{
+	PublishedResults results;
+	std::string error;
+	if (!results.open(name, error))
+	{
+		std::cout << "Publish: Error: " << error << std::endl;
+		return false;
+	}
+
+	auto symbols = [&](const char* title, const PublishedArray<PublishedSymbol>& table)
+	{
+		if (table.empty())
+			return;
+
+		std::cout << title << std::endl << "\tCode\tLexem" << std::endl << std::endl;
+		for (auto const& s : table)
+			std::cout << "\t" << s.id << "\t" << results.text(s.lexeme) << std::endl;
+		std::cout << std::endl;
+	};
+
+	auto diagnostics = [&](uint32_t parser)
+	{
+		for (auto const& d : results.diagnostics())
+		{
+			if (d.parser != parser)
+				continue;
+
+			// outputLex.txt has an empty line after every error
+			std::cout << results.text(d.message) << std::endl;
+			if (parser == 0)
+				std::cout << std::endl;
+		}
+	};
+
+	if (!results.tokens().empty())
+	{
+		std::cout << "Lexemes:" << std::endl << "\tRow\tCol\tCode\tLexem" << std::endl << std::endl;
+		for (auto const& t : results.tokens())
+			std::cout << "\t" << t.row << "\t" << t.col << "\t" << t.id << "\t" << results.text(t.value) << std::endl;
+		std::cout << std::endl << std::endl;
+	}
+
+	symbols("Constants:", results.constants());
+	symbols("Identifiers:", results.identifiers());
+	diagnostics(0);
+
+	for (auto const& n : results.nodes())
+	{
+		for (uint32_t i = 0; i < n.depth; i++)
+			std::cout << "|  ";
+		if (n.id != 0)
+			std::cout << n.id << " ";
+		std::cout << results.text(n.value) << '\n';
+	}
+	diagnostics(1);
+
+	return true;
+}
+
+struct TextToken
+{
+	int row = 0;
+	int col = 0;
+	int id = 0;
+	std::string value;
+};
+
+struct TextNode
+{
+	int depth = 0;
+	int id = 0;
+	std::string value;
+};
+
+// what consumers of the text outputs do: read both files and parse every line
+static size_t loadTextResults(const std::string& lexFile, const std::string& parFile)
+{
+	std::vector<TextToken> tokens;
+	std::vector<std::pair<int, std::string>> symbols;
+	std::vector<TextNode> nodes;
+	std::vector<std::string> diagnostics;
+
+	std::ifstream lex(lexFile);
+	std::string line;
+	int section = 0; // 1 lexemes, 2 constants and identifiers
+	while (std::getline(lex, line))
+	{
+		if (line == "Lexemes:")
+			section = 1;
+		else if (line == "Constants:" || line == "Identifiers:")
+			section = 2;
+		else if (line.empty() || line.compare(0, 5, "\tRow\t") == 0 || line.compare(0, 6, "\tCode\t") == 0)
+			continue;
+		else if (line[0] != '\t')
+			diagnostics.push_back(line);
+		else if (section == 1)
+		{
+			TextToken t;
+			char* end = nullptr;
+			t.row = (int)std::strtol(line.c_str() + 1, &end, 10);
+			t.col = (int)std::strtol(end + 1, &end, 10);
+			t.id = (int)std::strtol(end + 1, &end, 10);
+			t.value = end + 1;
+			tokens.push_back(std::move(t));
+		}
+		else
+		{
+			char* end = nullptr;
+			int id = (int)std::strtol(line.c_str() + 1, &end, 10);
+			symbols.emplace_back(id, end + 1);
+		}
+	}
+
+	std::ifstream par(parFile);
+	while (std::getline(par, line))
+	{
+		size_t at = 0;
+		TextNode n;
+		while (line.compare(at, 3, "|  ") == 0)
+		{
+			at += 3;
+			n.depth++;
+		}
+
+		if (at < line.size() && line[at] >= '0' && line[at] <= '9')
+		{
+			char* end = nullptr;
+			n.id = (int)std::strtol(line.c_str() + at, &end, 10);
+			n.value = end + 1;
+		}
+		else if (at < line.size() && line[at] == '<')
+			n.value = line.substr(at);
+		else
+		{
+			diagnostics.push_back(line);
+			continue;
+		}
+		nodes.push_back(std::move(n));
+	}
+
+	return tokens.size() + symbols.size() + nodes.size() + diagnostics.size();
+}
+
+void benchmarkPublishing(const std::string& filename)
+{
+	std::filesystem::path directory = std::filesystem::temp_directory_path();
+	std::string lexFile = (directory / "signal_publish.lex.txt").string();
+	std::string parFile = (directory / "signal_publish.par.txt").string();
+	std::string name = "/signal_publish";
+
+	std::ofstream silence; // the parser reports its outputs on std::cout
+	std::streambuf* console = std::cout.rdbuf(silence.rdbuf());
+
+	Parser par(filename, lexFile, parFile);
+	par.startParsing();
+
+	std::string error;
+	auto start = std::chrono::steady_clock::now();
+	bool published = publishResults(name, par, error);
+	std::chrono::duration<double> writing = std::chrono::steady_clock::now() - start;
+
+	std::cout.rdbuf(console);
+	if (!published)
+	{
+		std::cout << "Publish: Error: " << error << std::endl;
+		return;
+	}
+
+	double text = -1, open = -1, walk = -1;
+	size_t records = 0, mapped = 0, visited = 0;
+	for (int run = 0; run < 5; run++)
+	{
+		start = std::chrono::steady_clock::now();
+		records = loadTextResults(lexFile, parFile);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (text < 0 || elapsed.count() < text)
+			text = elapsed.count();
+
+		start = std::chrono::steady_clock::now();
+		PublishedResults results;
+		results.open(name, error);
+		elapsed = std::chrono::steady_clock::now() - start;
+		if (open < 0 || elapsed.count() < open)
+			open = elapsed.count();
+
+		// the first touch of every page is paid here
+		visited = 0;
+		for (auto const& t : results.tokens())
+			visited += t.id != 0;
+		for (auto const& n : results.nodes())
+			visited += n.end != 0;
+		visited += results.constants().size() + results.identifiers().size() + results.diagnostics().size();
+		elapsed = std::chrono::steady_clock::now() - start;
+		if (walk < 0 || elapsed.count() < walk)
+			walk = elapsed.count();
+
+		mapped = results.byteSize();
+	}
+
+	std::error_code ec;
+	uintmax_t textBytes = std::filesystem::file_size(lexFile, ec) + std::filesystem::file_size(parFile, ec);
+
+	std::cout << "records:\t" << records << " text, " << visited << " published" << std::endl;
+	std::cout << "text:\t" << textBytes / 1024 << " KB, read and parsed in " << text * 1000 << " ms" << std::endl;
+	std::cout << "shared memory:\t" << mapped / 1024 << " KB, written in " << writing.count() * 1000
+		<< " ms, mapped in " << open * 1000 << " ms, every record read in " << walk * 1000 << " ms" << std::endl;
+	std::cout << "speedup:\tx" << text / open << " to map, x" << text / walk << " to read every record" << std::endl;
+
+	unpublishResults(name);
+	std::filesystem::remove(lexFile, ec);
+	std::filesystem::remove(parFile, ec);
+}
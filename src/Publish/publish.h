@@ -0,0 +1,23 @@
+#pragma once
+
+#include "layout.h"
+#include "reader.h"
+#include "../Parser/parser.h"
+
+#include <string>
+
+// Writes the tokens, symbol tables, tree and diagnostics of a parsed program
+// into a new POSIX shared memory object (layout.h), replacing an earlier
+// object of the name. The parser must have built its tree, streaming and
+// listeners leave only the root.
+bool publishResults(const std::string&, const Parser&, std::string&);
+
+bool unpublishResults(const std::string&);
+
+// Prints a published compilation in the layout of outputLex.txt and
+// outputPar.txt, followed by the diagnostics
+bool showPublished(const std::string&);
+
+// Time a consumer needs to load the results of the file from outputLex.txt
+// and outputPar.txt compared to mapping the published object
+void benchmarkPublishing(const std::string&);
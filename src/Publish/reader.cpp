@@ -0,0 +1,106 @@
+#include "reader.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+PublishedResults::~PublishedResults()
+{
+	close();
+}
+
+bool PublishedResults::open(const std::string& name, std::string& error)
+{
+	close();
+
+#ifndef _WIN32
+	std::string object = publishedObjectName(name);
+
+	int descriptor = shm_open(object.c_str(), O_RDONLY, 0);
+	if (descriptor < 0)
+	{
+		error = "Can't open " + object;
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || (size_t)status.st_size < sizeof(PublishedHeader))
+	{
+		::close(descriptor);
+		error = object + " is too small";
+		return false;
+	}
+
+	size_t size = (size_t)status.st_size;
+	void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (p == MAP_FAILED)
+	{
+		error = "Can't map " + object;
+		return false;
+	}
+
+	memory = (const unsigned char*)p;
+	mapped = size;
+
+	const PublishedHeader* h = (const PublishedHeader*)memory;
+	if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != PublishedMagic)
+		error = object + " is not finished or not a compilation";
+	else if (h->major != PublishedMajor)
+		error = object + " has layout version " + std::to_string(h->major) + ", expected " + std::to_string(PublishedMajor);
+	else if (h->size > mapped || h->sectionCount < PublishedSectionCount)
+		error = object + " is truncated";
+
+	static const size_t recordSizes[PublishedSectionCount] = {
+		1, sizeof(PublishedToken), sizeof(PublishedSymbol), sizeof(PublishedSymbol), sizeof(PublishedNode), sizeof(PublishedDiagnostic)
+	};
+
+	for (int i = 0; i < PublishedSectionCount && error.empty(); i++)
+	{
+		const PublishedSection& s = h->sections[i];
+		if (s.recordSize < recordSizes[i] || s.offset % 8 != 0 || s.offset > h->size
+			|| s.count > (h->size - s.offset) / s.recordSize)
+			error = object + " has a damaged section " + std::to_string(i);
+	}
+
+	if (!error.empty())
+	{
+		close();
+		return false;
+	}
+
+	header = h;
+	return true;
+#else
+	error = "Shared memory is not supported on this system";
+	return false;
+#endif
+}
+
+void PublishedResults::close()
+{
+#ifndef _WIN32
+	if (memory != nullptr)
+		munmap((void*)memory, mapped);
+#endif
+	memory = nullptr;
+	mapped = 0;
+	header = nullptr;
+}
+
+std::string_view PublishedResults::text(const PublishedString& s) const
+{
+	const PublishedSection& strings = header->sections[PublishedStrings];
+	if ((uint64_t)s.offset + s.length > strings.count)
+		return std::string_view();
+
+	return std::string_view((const char*)memory + strings.offset + s.offset, s.length);
+}
+
+std::string publishedObjectName(const std::string& name)
+{
+	return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
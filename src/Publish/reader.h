@@ -0,0 +1,97 @@
+#pragma once
+
+#include "layout.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Records of one section, read in place with the record size the writer
+// used
+template <typename T>
+class PublishedArray
+{
+private:
+	const unsigned char* base = nullptr;
+	size_t count = 0;
+	size_t stride = sizeof(T);
+
+public:
+	class iterator
+	{
+	private:
+		const unsigned char* at;
+		size_t stride;
+
+	public:
+		iterator(const unsigned char* p, size_t s) : at(p), stride(s) {}
+
+		const T& operator*() const { return *(const T*)at; }
+		const T* operator->() const { return (const T*)at; }
+		bool operator!=(const iterator& other) const { return at != other.at; }
+
+		iterator& operator++()
+		{
+			at += stride;
+			return *this;
+		}
+	};
+
+	PublishedArray() {}
+	PublishedArray(const unsigned char* p, size_t n, size_t s) : base(p), count(n), stride(s) {}
+
+	const T& operator[](size_t i) const { return *(const T*)(base + i * stride); }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	iterator begin() const { return iterator(base, stride); }
+	iterator end() const { return iterator(base + count * stride, stride); }
+};
+
+// A published compilation mapped read-only. Opening checks the header and
+// the bounds of every section once; nothing is copied or decoded, records
+// and strings point into the mapping.
+class PublishedResults
+{
+private:
+	const unsigned char* memory = nullptr;
+	size_t mapped = 0;
+	const PublishedHeader* header = nullptr;
+
+public:
+	PublishedResults() {}
+	~PublishedResults();
+
+	PublishedResults(const PublishedResults&) = delete;
+	PublishedResults& operator=(const PublishedResults&) = delete;
+
+	// false with a message when the object is missing, unfinished or of another major version
+	bool open(const std::string&, std::string&);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+
+	uint16_t minorVersion() const { return header->minor; }
+	size_t byteSize() const { return mapped; }
+	bool hasLexerErrors() const { return (header->flags & PublishedLexerErrors) != 0; }
+	bool hasParserErrors() const { return (header->flags & PublishedParserErrors) != 0; }
+
+	PublishedArray<PublishedToken> tokens() const { return section<PublishedToken>(PublishedTokens); }
+	PublishedArray<PublishedSymbol> constants() const { return section<PublishedSymbol>(PublishedConstants); }
+	PublishedArray<PublishedSymbol> identifiers() const { return section<PublishedSymbol>(PublishedIdentifiers); }
+	PublishedArray<PublishedNode> nodes() const { return section<PublishedNode>(PublishedNodes); }
+	PublishedArray<PublishedDiagnostic> diagnostics() const { return section<PublishedDiagnostic>(PublishedDiagnostics); }
+
+	// empty for strings outside of the Strings section
+	std::string_view text(const PublishedString&) const;
+
+private:
+	template <typename T>
+	PublishedArray<T> section(int kind) const
+	{
+		const PublishedSection& s = header->sections[kind];
+		return PublishedArray<T>(memory + s.offset, (size_t)s.count, s.recordSize);
+	}
+};
+
+// "/name" for a name without the leading slash of POSIX shared memory
+std::string publishedObjectName(const std::string&);
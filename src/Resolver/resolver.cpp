@@ -0,0 +1,236 @@
+#include "resolver.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile() : begin(nullptr), length(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize))
+	{
+		close();
+		return false;
+	}
+
+	length = (size_t)fileSize.QuadPart;
+	if (length == 0) // empty files can't be mapped
+		return true;
+
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle != nullptr)
+		begin = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+	if (begin == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (begin != nullptr)
+		UnmapViewOfFile(begin);
+	if (mappingHandle != nullptr)
+		CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(fileHandle);
+
+	begin = nullptr;
+	length = 0;
+	mappingHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		return false;
+	}
+
+	length = (size_t)st.st_size;
+	if (length > 0)
+	{
+		void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			::close(fd);
+			length = 0;
+			return false;
+		}
+		begin = (const char*)p;
+	}
+
+	::close(fd); // the mapping stays valid without the descriptor
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (begin != nullptr)
+		munmap((void*)begin, length);
+
+	begin = nullptr;
+	length = 0;
+}
+
+#endif
+
+AsmResolver::AsmResolver() : extensions({ "", ".asm", ".inc" })
+{
+}
+
+void AsmResolver::addSearchPath(const std::string& path)
+{
+	if (path.empty())
+		return;
+
+	char last = path.back();
+	if (last == '/' || last == '\\')
+		searchPaths.push_back(path);
+	else
+		searchPaths.push_back(path + "/");
+}
+
+void AsmResolver::addExtension(const std::string& ext)
+{
+	extensions.push_back(ext);
+}
+
+const AsmInsert* AsmResolver::resolve(const std::string& name)
+{
+	lookups++;
+
+	auto cached = byName.find(name);
+	if (cached != byName.end())
+		return cached->second;
+
+	const AsmInsert* insert = nullptr;
+	for (auto const& dir : searchPaths)
+	{
+		for (auto const& ext : extensions)
+		{
+			insert = load(dir + name + ext);
+			if (insert != nullptr)
+				break;
+		}
+
+		if (insert != nullptr)
+			break;
+	}
+
+	byName[name] = insert;
+	return insert;
+}
+
+void AsmResolver::invalidate(const std::string& name)
+{
+	auto cached = byName.find(name);
+	if (cached == byName.end())
+		return;
+
+	const AsmInsert* insert = cached->second;
+	byName.erase(cached);
+
+	if (insert == nullptr)
+		return;
+
+	for (auto const& i : byName)
+	{
+		if (i.second == insert)
+			return;
+	}
+
+	auto range = byHash.equal_range(insert->hash);
+	for (auto i = range.first; i != range.second; i++)
+	{
+		if (i->second.get() == insert)
+		{
+			byHash.erase(i);
+			break;
+		}
+	}
+}
+
+const AsmInsert* AsmResolver::load(const std::string& path)
+{
+	std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+	if (!file->open(path))
+		return nullptr;
+
+	mapped++;
+	uint64_t hash = hashContent(file->data(), file->size());
+
+	auto range = byHash.equal_range(hash);
+	for (auto i = range.first; i != range.second; i++)
+	{
+		const MappedFile& other = *i->second->file;
+		if (other.size() == file->size() &&
+			(file->size() == 0 || std::memcmp(other.data(), file->data(), file->size()) == 0))
+		{
+			return i->second.get(); // duplicate content, the new mapping is released
+		}
+	}
+
+	std::unique_ptr<AsmInsert> insert = std::make_unique<AsmInsert>();
+	insert->path = path;
+	insert->hash = hash;
+	insert->file = std::move(file);
+
+	return byHash.emplace(hash, std::move(insert))->second.get();
+}
+
+uint64_t AsmResolver::hashContent(const char* data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
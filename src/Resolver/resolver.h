@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const char* begin;
+	size_t length;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string&);
+	void close();
+
+	const char* data() const { return begin; }
+	size_t size() const { return length; }
+};
+
+struct AsmInsert
+{
+	std::string path = "";
+	uint64_t hash = 0;
+	std::unique_ptr<MappedFile> file;
+};
+
+// Locates "($ NAME $)" insert files and keeps them mapped for a whole batch.
+// Every name is looked up on disk once, and files with identical content share one mapping.
+class AsmResolver
+{
+private:
+	std::vector<std::string> searchPaths;
+	std::vector<std::string> extensions;
+
+	std::unordered_map<std::string, const AsmInsert*> byName; // nullptr for missing files
+	std::unordered_multimap<uint64_t, std::unique_ptr<AsmInsert>> byHash;
+
+	size_t lookups = 0;
+	size_t mapped = 0;
+
+public:
+	AsmResolver();
+
+	void addSearchPath(const std::string&);
+	void addExtension(const std::string&);
+
+	const AsmInsert* resolve(const std::string&);
+
+	// looks the name up on disk again on the next resolve; its mapping is
+	// released when no other name refers to it
+	void invalidate(const std::string&);
+
+	size_t lookupCount() const { return lookups; }
+	size_t mappedCount() const { return mapped; }
+	size_t uniqueCount() const { return byHash.size(); }
+
+private:
+	const AsmInsert* load(const std::string&);
+	static uint64_t hashContent(const char*, size_t);
+};
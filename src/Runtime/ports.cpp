@@ -0,0 +1,371 @@
+#include "ports.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#define sysRead _read
+#define sysWrite _write
+#define sysClose _close
+#define sysOpen _open
+#define OPEN_BINARY _O_BINARY
+#else
+#include <unistd.h>
+#define sysRead ::read
+#define sysWrite ::write
+#define sysClose ::close
+#define sysOpen ::open
+#define OPEN_BINARY 0
+#endif
+
+#ifndef EWOULDBLOCK
+#define EWOULDBLOCK EAGAIN
+#endif
+
+FileDevice::FileDevice(int in, int out, bool ownsDescriptors) :
+	input(in), output(out), owns(ownsDescriptors), pendingBytes(0)
+{
+}
+
+FileDevice::~FileDevice()
+{
+#ifndef _WIN32
+	// a descriptor shared with others, like stdin, waits for data again
+	if (inputFlags >= 0)
+		fcntl(input, F_SETFL, inputFlags);
+#endif
+
+	if (!owns)
+		return;
+
+	if (input >= 0)
+		sysClose(input);
+	if (output >= 0 && output != input)
+		sysClose(output);
+}
+
+std::unique_ptr<FileDevice> FileDevice::open(const std::string& inputPath, const std::string& outputPath)
+{
+	int in = -1;
+	int out = -1;
+
+	if (!inputPath.empty())
+	{
+		in = sysOpen(inputPath.c_str(), O_RDONLY | OPEN_BINARY);
+		if (in < 0)
+		{
+			std::cout << "Error: Can't open port input " << inputPath << std::endl;
+			return nullptr;
+		}
+	}
+
+	if (!outputPath.empty())
+	{
+		out = sysOpen(outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | OPEN_BINARY, 0644);
+		if (out < 0)
+		{
+			std::cout << "Error: Can't open port output " << outputPath << std::endl;
+			if (in >= 0)
+				sysClose(in);
+			return nullptr;
+		}
+	}
+
+	return std::make_unique<FileDevice>(in, out, true);
+}
+
+size_t FileDevice::read(unsigned int* words, size_t count)
+{
+	if (input < 0 || count == 0)
+		return 0;
+
+	// pipes may return a part of a word, it is kept for the next call
+	char* bytes = (char*)words;
+	size_t total = pendingBytes;
+	std::memcpy(bytes, pending, pendingBytes);
+
+	while (total < sizeof(unsigned int))
+	{
+		long got = (long)sysRead(input, bytes + total, (unsigned int)(count * sizeof(unsigned int) - total));
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+		{
+			// a non-blocking pipe without data may have some later
+			if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				atEnd = true;
+
+			pendingBytes = total;
+			std::memcpy(pending, bytes, total);
+			return 0;
+		}
+
+		total += (size_t)got;
+	}
+
+	size_t whole = total / sizeof(unsigned int);
+	pendingBytes = total % sizeof(unsigned int);
+	std::memcpy(pending, bytes + whole * sizeof(unsigned int), pendingBytes);
+
+	return whole;
+}
+
+bool FileDevice::setNonBlocking()
+{
+	if (input < 0 || inputFlags >= 0)
+		return true;
+
+#ifdef _WIN32
+	// _read waits on pipes and consoles, only a file returns at its end
+	struct _stat st;
+	return _fstat(input, &st) == 0 && (st.st_mode & _S_IFREG) != 0;
+#else
+	int flags = fcntl(input, F_GETFL);
+	if (flags < 0 || fcntl(input, F_SETFL, flags | O_NONBLOCK) < 0)
+		return false;
+
+	inputFlags = flags;
+	return true;
+#endif
+}
+
+size_t FileDevice::write(const unsigned int* words, size_t count)
+{
+	if (output < 0)
+		return count; // unbound output discards words
+
+	const char* bytes = (const char*)words;
+	size_t left = count * sizeof(unsigned int);
+
+	while (left > 0)
+	{
+		long put = (long)sysWrite(output, bytes, (unsigned int)left);
+		if (put < 0 && errno == EINTR)
+			continue;
+		if (put <= 0)
+			break;
+
+		bytes += put;
+		left -= (size_t)put;
+	}
+
+	// a word written in part counts as refused
+	return (count * sizeof(unsigned int) - left) / sizeof(unsigned int);
+}
+
+MemoryDevice::MemoryDevice(const std::vector<unsigned int>* in, std::vector<unsigned int>* out) :
+	input(in), output(out)
+{
+}
+
+size_t MemoryDevice::read(unsigned int* words, size_t count)
+{
+	if (input == nullptr || index >= input->size())
+		return 0;
+
+	size_t n = std::min(count, input->size() - index);
+	std::memcpy(words, input->data() + index, n * sizeof(unsigned int));
+	index += n;
+
+	return n;
+}
+
+size_t MemoryDevice::write(const unsigned int* words, size_t count)
+{
+	if (output != nullptr)
+		output->insert(output->end(), words, words + count);
+
+	return count;
+}
+
+RingBuffer::RingBuffer(size_t size)
+{
+	size_t capacity = 1;
+	while (capacity < size)
+		capacity *= 2;
+
+	data.resize(capacity);
+	mask = capacity - 1;
+}
+
+unsigned int* RingBuffer::freeSpan(size_t& n)
+{
+	size_t start = tail & mask;
+	n = std::min(data.size() - size(), data.size() - start);
+	return data.data() + start;
+}
+
+const unsigned int* RingBuffer::usedSpan(size_t& n)
+{
+	size_t start = head & mask;
+	n = std::min(size(), data.size() - start);
+	return data.data() + start;
+}
+
+Port::Port(std::unique_ptr<PortDevice> portDevice, size_t capacity) :
+	input(capacity), output(capacity), device(std::move(portDevice))
+{
+}
+
+Port::~Port()
+{
+	flush();
+}
+
+bool Port::refill()
+{
+	size_t n;
+	unsigned int* span = input.freeSpan(n);
+
+	size_t got = device->read(span, n);
+	transfers++;
+
+	input.commit(got);
+	return got > 0;
+}
+
+size_t Port::flush()
+{
+	size_t refused = 0;
+
+	while (!output.empty())
+	{
+		size_t n;
+		const unsigned int* span = output.usedSpan(n);
+
+		size_t put = device->write(span, n);
+		transfers++;
+
+		output.consume(n);
+		if (put < n)
+		{
+			// the device failed, the rest is not tried
+			refused = n - put + output.size();
+			break;
+		}
+	}
+
+	output.consume(output.size());
+	dropped += refused;
+
+	return refused;
+}
+
+PortTable::PortTable(size_t bufferSize) : capacity(bufferSize)
+{
+}
+
+Port* PortTable::bind(unsigned int number, std::unique_ptr<PortDevice> device)
+{
+	std::unique_ptr<Port>& port = ports[number];
+	port = std::make_unique<Port>(std::move(device), capacity);
+
+	return port.get();
+}
+
+Port* PortTable::find(unsigned int number) const
+{
+	auto i = ports.find(number);
+	return i == ports.end() ? nullptr : i->second.get();
+}
+
+void PortTable::flush()
+{
+	for (auto& i : ports)
+		i.second->flush();
+}
+
+size_t PortTable::transferCount() const
+{
+	size_t count = 0;
+	for (auto const& i : ports)
+		count += i.second->transferCount();
+
+	return count;
+}
+
+size_t PortTable::droppedCount() const
+{
+	size_t count = 0;
+	for (auto const& i : ports)
+		count += i.second->droppedCount();
+
+	return count;
+}
+
+static void reportPorts(const std::string& name, size_t ops, double seconds, size_t transfers)
+{
+	std::cout << "\t" << name << ":\t" << (size_t)(ops / seconds) << " ops/sec, "
+		<< (double)transfers * 1000 / ops << " transfers per 1000 ops" << std::endl;
+}
+
+void benchmarkPorts(size_t count, const std::string& workFile)
+{
+	std::cout << "Ports: " << count << " IN + OUT pairs" << std::endl;
+
+	std::vector<unsigned int> source(count);
+	for (size_t i = 0; i < count; i++)
+		source[i] = (unsigned int)i;
+
+	// in memory
+	{
+		std::vector<unsigned int> sink;
+		sink.reserve(count);
+
+		PortTable table;
+		Port* in = table.bind(1, std::make_unique<MemoryDevice>(&source, nullptr));
+		Port* out = table.bind(2, std::make_unique<MemoryDevice>(nullptr, &sink));
+
+		auto start = std::chrono::steady_clock::now();
+
+		unsigned int value;
+		while (in->read(value))
+			out->write(value);
+		table.flush();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		reportPorts("memory", 2 * count, elapsed.count(), table.transferCount());
+	}
+
+	// file to file
+	{
+		std::unique_ptr<FileDevice> writer = FileDevice::open("", workFile);
+		if (writer == nullptr)
+			return;
+		writer->write(source.data(), source.size());
+		writer.reset();
+
+		std::string copyFile = workFile + ".out";
+		std::unique_ptr<FileDevice> inDevice = FileDevice::open(workFile, "");
+		std::unique_ptr<FileDevice> outDevice = FileDevice::open("", copyFile);
+		if (inDevice == nullptr || outDevice == nullptr)
+			return;
+
+		{
+			PortTable table;
+			Port* in = table.bind(1, std::move(inDevice));
+			Port* out = table.bind(2, std::move(outDevice));
+
+			auto start = std::chrono::steady_clock::now();
+
+			unsigned int value;
+			while (in->read(value))
+				out->write(value);
+			table.flush();
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			reportPorts("file", 2 * count, elapsed.count(), table.transferCount());
+		}
+
+		std::remove(copyFile.c_str());
+	}
+
+	std::remove(workFile.c_str());
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstddef>
+
+// Source and destination of a port's data. Devices move whole blocks of
+// words, so one system call is shared by many IN/OUT operations.
+class PortDevice
+{
+public:
+	virtual ~PortDevice() {}
+
+	virtual size_t read(unsigned int*, size_t) = 0; // 0 when nothing more can be read
+	virtual size_t write(const unsigned int*, size_t) = 0; // whole words written
+
+	// after read returned 0: false when more may come later, like from an empty pipe
+	virtual bool ended() const { return true; }
+	// read returns 0 instead of waiting for data, false when the device can't
+	virtual bool setNonBlocking() { return true; }
+};
+
+// File or pipe descriptors, words are stored in native binary form
+class FileDevice : public PortDevice
+{
+private:
+	int input;
+	int output;
+	bool owns;
+
+	char pending[sizeof(unsigned int)];
+	size_t pendingBytes;
+	bool atEnd = false;
+	int inputFlags = -1; // restored when O_NONBLOCK was set
+
+public:
+	FileDevice(int, int, bool);
+	~FileDevice();
+
+	static std::unique_ptr<FileDevice> open(const std::string&, const std::string&);
+
+	size_t read(unsigned int*, size_t) override;
+	size_t write(const unsigned int*, size_t) override;
+	bool ended() const override { return atEnd; }
+	bool setNonBlocking() override;
+};
+
+class MemoryDevice : public PortDevice
+{
+private:
+	const std::vector<unsigned int>* input;
+	std::vector<unsigned int>* output;
+	size_t index = 0;
+
+public:
+	MemoryDevice(const std::vector<unsigned int>*, std::vector<unsigned int>*);
+
+	size_t read(unsigned int*, size_t) override;
+	size_t write(const unsigned int*, size_t) override;
+	bool ended() const override { return input == nullptr || index >= input->size(); }
+};
+
+class RingBuffer
+{
+private:
+	std::vector<unsigned int> data;
+	size_t mask;
+	size_t head = 0; // next word to read, both counters only grow
+	size_t tail = 0; // next word to write
+
+public:
+	RingBuffer(size_t);
+
+	size_t size() const { return tail - head; }
+	size_t capacity() const { return data.size(); }
+	bool empty() const { return head == tail; }
+	bool full() const { return size() == data.size(); }
+
+	void push(unsigned int value) { data[tail++ & mask] = value; }
+	unsigned int pop() { return data[head++ & mask]; }
+
+	// contiguous regions for block transfers
+	unsigned int* freeSpan(size_t&);
+	void commit(size_t n) { tail += n; }
+	const unsigned int* usedSpan(size_t&);
+	void consume(size_t n) { head += n; }
+};
+
+class Port
+{
+private:
+	RingBuffer input;
+	RingBuffer output;
+	std::unique_ptr<PortDevice> device;
+
+	size_t transfers = 0;
+	size_t dropped = 0; // words the device refused
+
+public:
+	Port(std::unique_ptr<PortDevice>, size_t);
+	~Port();
+
+	// false when no word is available from the device
+	bool read(unsigned int& value)
+	{
+		if (input.empty() && !refill())
+			return false;
+
+		value = input.pop();
+		return true;
+	}
+
+	void write(unsigned int value)
+	{
+		if (output.full())
+			flush();
+
+		output.push(value);
+	}
+
+	// words the device refuses are dropped, returns how many
+	size_t flush();
+
+	// words read in advance, refilled from the device when there are none
+	size_t available()
+	{
+		if (input.empty())
+			refill();
+
+		return input.size();
+	}
+
+	// no word is left and the device won't have more
+	bool ended() const { return input.empty() && device->ended(); }
+	bool setNonBlocking() { return device->setNonBlocking(); }
+
+	size_t transferCount() const { return transfers; }
+	size_t droppedCount() const { return dropped; }
+
+private:
+	bool refill();
+};
+
+// Ports of a running program, by the number used in "IN n;" / "OUT n;"
+class PortTable
+{
+private:
+	std::unordered_map<unsigned int, std::unique_ptr<Port>> ports;
+	size_t capacity;
+
+public:
+	PortTable(size_t = 4096);
+
+	Port* bind(unsigned int, std::unique_ptr<PortDevice>);
+	Port* find(unsigned int) const;
+
+	void flush();
+	size_t transferCount() const;
+	size_t droppedCount() const;
+};
+
+// IN/OUT loop throughput through memory and file bound ports
+void benchmarkPorts(size_t, const std::string&);
@@ -0,0 +1,713 @@
+#include "scheduler.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <algorithm>
+
+// constants wrap around like a 32-bit register
+static unsigned int toWord(const std::string& digits)
+{
+	unsigned int value = 0;
+	for (char c : digits)
+		value = value * 10 + (unsigned int)(c - '0');
+
+	return value;
+}
+
+bool ExecutableProgram::load(const FlatProgram& flat, std::string& error)
+{
+	name = flat.name;
+	code.clear();
+	variables.clear();
+
+	std::unordered_map<std::string, int> slots;
+	std::unordered_map<std::string, int> labels; // the first definition wins
+
+	auto slot = [&](const std::string& variable)
+	{
+		auto i = slots.find(variable);
+		if (i != slots.end())
+			return i->second;
+
+		variables.push_back(variable);
+		return slots[variable] = (int)variables.size() - 1;
+	};
+
+	for (size_t i = 0; i < flat.statements.size(); i++)
+	{
+		for (auto const& label : flat.statements[i].labels)
+			labels.emplace(label, (int)i);
+	}
+
+	for (auto const& s : flat.statements)
+	{
+		Instruction instruction;
+		instruction.kind = s.kind;
+
+		const std::vector<std::string>& op = s.operands;
+		switch (s.kind)
+		{
+		case StatementKind::Assign:
+			instruction.variable = slot(op[0]);
+			instruction.value = toWord(op[1]);
+			break;
+
+		case StatementKind::Goto:
+		{
+			auto label = labels.find(op[0]);
+			if (label == labels.end())
+			{
+				error = "label " + op[0] + " of GOTO is not defined.";
+				return false;
+			}
+
+			instruction.target = label->second;
+			break;
+		}
+
+		case StatementKind::Link:
+			instruction.variable = slot(op[0]);
+			instruction.value = toWord(op[1]);
+			break;
+
+		case StatementKind::In:
+		case StatementKind::Out:
+			instruction.value = toWord(op[0]);
+			break;
+
+		default:
+			break; // calls and assembly inserts are external, they only take their turn
+		}
+
+		code.push_back(instruction);
+	}
+
+	return true;
+}
+
+Scheduler::Scheduler(unsigned int threadCount, size_t statements, size_t capacity) :
+	threads(threadCount), budget(statements), portCapacity(capacity)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < threads; i++)
+		workers.push_back(std::make_unique<Worker>());
+}
+
+Channel& Scheduler::channel(unsigned int number)
+{
+	std::unique_ptr<Channel>& c = channels[number];
+	if (c == nullptr)
+	{
+		c = std::make_unique<Channel>();
+		c->capacity = portCapacity;
+	}
+
+	return *c;
+}
+
+Task* Scheduler::spawn(const ExecutableProgram& program)
+{
+	tasks.push_back(std::make_unique<Task>());
+	Task* task = tasks.back().get();
+
+	task->id = tasks.size() - 1;
+	task->program = &program;
+	task->values.assign(program.variables.size(), 0);
+
+	// ports are created before the run, workers only look them up
+	for (auto const& i : program.code)
+	{
+		if (i.kind == StatementKind::In || i.kind == StatementKind::Out)
+			channel(i.value);
+	}
+
+	workers[task->id % threads]->queue.push_back(task);
+	live++;
+
+	return task;
+}
+
+bool Scheduler::bind(unsigned int number, std::unique_ptr<PortDevice> device)
+{
+	// IN reads the device on a worker holding the port
+	if (!device->setNonBlocking())
+	{
+		std::cout << "Scheduler: Error (port " << number << "): the device can't be read without waiting, not bound." << std::endl;
+		return false;
+	}
+
+	channel(number).port = std::make_unique<Port>(std::move(device), portCapacity);
+	return true;
+}
+
+void Scheduler::run(double seconds)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (auto& w : workers)
+	{
+		for (Task* t : w->queue)
+			t->queuedAt = t->runnableAt = start;
+	}
+
+	stopping = false;
+
+	std::vector<std::thread> pool;
+	for (unsigned int w = 0; w < threads; w++)
+		pool.emplace_back(&Scheduler::work, this, w);
+
+	auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		// nothing runs once live is 0, only the poll can wake a task then
+		size_t running = live.load();
+		if (!pollPorts() && running == 0)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	stopping = true;
+	for (auto& t : pool)
+		t.join();
+
+	std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+	elapsed = time.count();
+
+	// tasks the workers left in their queues
+	for (auto& w : workers)
+	{
+		for (Task* t : w->queue)
+			leaveRunnable(*t, TaskState::Stopped);
+		w->queue.clear();
+	}
+
+	for (auto& c : channels)
+	{
+		if (c.second->port != nullptr)
+			c.second->port->flush();
+	}
+}
+
+void Scheduler::work(size_t w)
+{
+	size_t idle = 0;
+
+	while (!stopping.load(std::memory_order_relaxed))
+	{
+		Task* task = next(w);
+		if (task == nullptr)
+		{
+			// tasks running elsewhere or the port poll may still wake parked ones
+			if (++idle < 64)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			continue;
+		}
+
+		idle = 0;
+		execute(w, *task);
+	}
+}
+
+Task* Scheduler::next(size_t w)
+{
+	Worker& own = *workers[w];
+	Task* task = nullptr;
+
+	{
+		std::lock_guard<std::mutex> hold(own.lock);
+		if (!own.queue.empty())
+		{
+			task = own.queue.front();
+			own.queue.pop_front();
+		}
+	}
+
+	// half of the first queue that has work, from the back
+	for (unsigned int i = 1; task == nullptr && i < threads; i++)
+	{
+		Worker& victim = *workers[(w + i) % threads];
+		std::vector<Task*> stolen;
+		{
+			std::lock_guard<std::mutex> hold(victim.lock);
+			size_t n = (victim.queue.size() + 1) / 2;
+			for (size_t k = 0; k < n; k++)
+			{
+				stolen.push_back(victim.queue.back());
+				victim.queue.pop_back();
+			}
+		}
+
+		if (stolen.empty())
+			continue;
+
+		own.steals++;
+		task = stolen.back();
+		stolen.pop_back();
+
+		std::lock_guard<std::mutex> hold(own.lock);
+		own.queue.insert(own.queue.end(), stolen.rbegin(), stolen.rend());
+	}
+
+	if (task != nullptr)
+	{
+		std::chrono::duration<double> wait = std::chrono::steady_clock::now() - task->queuedAt;
+		task->waitSeconds += wait.count();
+		task->maxWaitSeconds = std::max(task->maxWaitSeconds, wait.count());
+		task->slices++;
+		own.slices++;
+	}
+
+	return task;
+}
+
+void Scheduler::schedule(size_t w, Task* task)
+{
+	task->queuedAt = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> hold(workers[w]->lock);
+	workers[w]->queue.push_back(task);
+}
+
+void Scheduler::execute(size_t w, Task& task)
+{
+	const std::vector<Instruction>& code = task.program->code;
+	size_t slice = 0;
+
+	while (task.pc < (int)code.size())
+	{
+		const Instruction& i = code[task.pc];
+
+		switch (i.kind)
+		{
+		case StatementKind::Assign:
+			task.values[i.variable] = i.value;
+			break;
+
+		case StatementKind::Goto:
+		{
+			bool back = i.target <= task.pc;
+			task.pc = i.target;
+			slice++;
+
+			// only loops run for long, so their back-edges are the preemption points
+			if (back && (slice >= budget || stopping.load(std::memory_order_relaxed)))
+			{
+				task.statements += slice;
+
+				if (stopping.load())
+				{
+					leaveRunnable(task, TaskState::Stopped);
+					live--;
+				}
+				else
+					schedule(w, &task);
+				return;
+			}
+			continue;
+		}
+
+		case StatementKind::Link:
+		{
+			std::pair<unsigned int, int> link(i.value, i.variable);
+			if (std::find(task.links.begin(), task.links.end(), link) == task.links.end())
+				task.links.push_back(link);
+			break;
+		}
+
+		case StatementKind::In:
+		case StatementKind::Out:
+			// a parked task may run on another worker as soon as the port is unlocked
+			task.statements += slice;
+			slice = 0;
+
+			if (!(i.kind == StatementKind::In ? in(task, i, w) : out(task, i, w)))
+				return;
+			break;
+
+		case StatementKind::Return:
+			task.pc = (int)code.size() - 1;
+			break;
+
+		default:
+			break;
+		}
+
+		task.pc++;
+		slice++;
+	}
+
+	task.statements += slice;
+	leaveRunnable(task, TaskState::Done);
+	live--;
+}
+
+void Scheduler::leaveRunnable(Task& task, TaskState state)
+{
+	std::chrono::duration<double> runnable = std::chrono::steady_clock::now() - task.runnableAt;
+	task.runnableSeconds += runnable.count();
+	task.state = state;
+}
+
+// wakes a reader parked on a device port for every word the device has now,
+// true while readers wait for a device that may have more
+bool Scheduler::pollPorts()
+{
+	bool waiting = false;
+	size_t w = 0;
+
+	for (auto& i : channels)
+	{
+		Channel& c = *i.second;
+		if (c.port == nullptr)
+			continue;
+
+		std::vector<Task*> woken;
+		{
+			std::lock_guard<std::mutex> hold(c.lock);
+			if (c.readers.empty())
+				continue;
+
+			size_t n = std::min(c.readers.size(), c.port->available());
+			for (size_t k = 0; k < n; k++)
+			{
+				woken.push_back(c.readers.front());
+				c.readers.pop_front();
+			}
+
+			if (!woken.empty() || !c.port->ended())
+				waiting = true;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		for (Task* reader : woken)
+		{
+			reader->state = TaskState::Runnable;
+			reader->runnableAt = now;
+			live++;
+			schedule(w++ % threads, reader);
+		}
+	}
+
+	return waiting;
+}
+
+// IN stores the oldest word of the port in every variable linked to it,
+// false when the task parked
+bool Scheduler::in(Task& task, const Instruction& i, size_t w)
+{
+	Channel& c = *channels.find(i.value)->second;
+	unsigned int word = 0;
+	Task* writer = nullptr;
+
+	{
+		std::lock_guard<std::mutex> hold(c.lock);
+
+		if (!c.words.empty())
+		{
+			word = c.words.front();
+			c.words.pop_front();
+
+			if (!c.writers.empty())
+			{
+				writer = c.writers.front();
+				c.writers.pop_front();
+			}
+		}
+		else if (c.port == nullptr || !c.port->read(word))
+		{
+			leaveRunnable(task, TaskState::Parked);
+			task.parks++;
+			c.readers.push_back(&task);
+			live--;
+			return false;
+		}
+	}
+
+	for (auto const& l : task.links)
+	{
+		if (l.first == i.value)
+			task.values[l.second] = word;
+	}
+
+	if (writer != nullptr)
+	{
+		writer->state = TaskState::Runnable;
+		writer->runnableAt = std::chrono::steady_clock::now();
+		live++;
+		schedule(w, writer);
+	}
+
+	return true;
+}
+
+// OUT sends the variable linked to the port last, 0 when there is none
+bool Scheduler::out(Task& task, const Instruction& i, size_t w)
+{
+	Channel& c = *channels.find(i.value)->second;
+	unsigned int word = 0;
+	Task* reader = nullptr;
+
+	for (auto const& l : task.links)
+	{
+		if (l.first == i.value)
+			word = task.values[l.second];
+	}
+
+	{
+		std::lock_guard<std::mutex> hold(c.lock);
+
+		if (c.port != nullptr)
+			c.port->write(word);
+		else if (c.words.size() >= c.capacity)
+		{
+			leaveRunnable(task, TaskState::Parked);
+			task.parks++;
+			c.writers.push_back(&task);
+			live--;
+			return false;
+		}
+		else
+		{
+			c.words.push_back(word);
+
+			if (!c.readers.empty())
+			{
+				reader = c.readers.front();
+				c.readers.pop_front();
+			}
+		}
+	}
+
+	if (reader != nullptr)
+	{
+		reader->state = TaskState::Runnable;
+		reader->runnableAt = std::chrono::steady_clock::now();
+		live++;
+		schedule(w, reader);
+	}
+
+	return true;
+}
+
+size_t Scheduler::statementCount() const
+{
+	size_t count = 0;
+	for (auto const& t : tasks)
+		count += t->statements;
+
+	return count;
+}
+
+double Scheduler::fairness() const
+{
+	double sum = 0;
+	double squares = 0;
+	size_t n = 0;
+
+	for (auto const& t : tasks)
+	{
+		if (t->state != TaskState::Stopped || t->parks > 0)
+			continue;
+
+		sum += (double)t->statements;
+		squares += (double)t->statements * (double)t->statements;
+		n++;
+	}
+
+	return squares > 0 ? sum * sum / (n * squares) : 1;
+}
+
+double Scheduler::runnableFairness() const
+{
+	double sum = 0;
+	double squares = 0;
+	size_t n = 0;
+
+	for (auto const& t : tasks)
+	{
+		if (t->runnableSeconds <= 0)
+			continue;
+
+		double rate = (double)t->statements / t->runnableSeconds;
+		sum += rate;
+		squares += rate * rate;
+		n++;
+	}
+
+	return squares > 0 ? sum * sum / (n * squares) : 1;
+}
+
+void Scheduler::printStatistics(std::ostream& out) const
+{
+	size_t states[4] = { 0, 0, 0, 0 };
+	size_t slices = 0;
+	size_t steals = 0;
+	double wait = 0;
+	double maxWait = 0;
+
+	for (auto const& t : tasks)
+	{
+		states[(int)t->state]++;
+		wait += t->waitSeconds;
+		maxWait = std::max(maxWait, t->maxWaitSeconds);
+	}
+
+	for (auto const& w : workers)
+	{
+		slices += w->slices;
+		steals += w->steals;
+	}
+
+	size_t statements = statementCount();
+
+	size_t dropped = 0;
+	for (auto const& c : channels)
+	{
+		if (c.second->port != nullptr)
+			dropped += c.second->port->droppedCount();
+	}
+
+	out << "Scheduler: " << tasks.size() << " tasks on " << threads << " threads, budget " << budget << ": "
+		<< states[(int)TaskState::Done] << " done, " << states[(int)TaskState::Parked] << " parked, "
+		<< states[(int)TaskState::Stopped] << " stopped" << std::endl;
+	out << "Scheduler: " << statements << " statements in " << elapsed * 1000 << " ms, "
+		<< (size_t)(elapsed > 0 ? statements / elapsed : 0) << " statements/s" << std::endl;
+	out << "Scheduler: " << slices << " slices, " << steals << " steals, fairness " << fairness()
+		<< " (loops that never parked), " << runnableFairness() << " (all tasks, per second runnable)"
+		<< ", wait " << (slices > 0 ? wait / slices * 1e6 : 0) << " us mean, " << maxWait * 1e6 << " us max" << std::endl;
+
+	if (dropped > 0)
+		out << "Scheduler: Error: " << dropped << " words could not be written to their ports and were dropped" << std::endl;
+}
+
+static bool loadProgram(const SourceText& source, const std::string& origin, ExecutableProgram& program)
+{
+	Parser par(source, "", "");
+	par.startParsing();
+
+	FlatProgram flat;
+	if (par.hasErrors() || !flat.fromTree(par.getTree()))
+	{
+		std::cout << "Scheduler: Error (" << origin << "): program has errors, not run." << std::endl;
+		return false;
+	}
+
+	std::string error;
+	if (!program.load(flat, error))
+	{
+		std::cout << "Scheduler: Error (" << origin << "): " << error << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool runPrograms(const std::vector<std::string>& files, size_t copies, unsigned int threads, size_t budget, double seconds)
+{
+	std::vector<std::unique_ptr<ExecutableProgram>> programs;
+	bool loaded = true;
+
+	for (auto const& filename : files)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cout << "Scheduler: Error (" << filename << "): can't open the file." << std::endl;
+			loaded = false;
+			continue;
+		}
+
+		std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		auto program = std::make_unique<ExecutableProgram>();
+		if (!loadProgram(SourceText{ text }, filename, *program))
+		{
+			loaded = false;
+			continue;
+		}
+
+		programs.push_back(std::move(program));
+	}
+
+	Scheduler scheduler(threads, budget);
+	for (auto const& p : programs)
+	{
+		for (size_t i = 0; i < copies; i++)
+			scheduler.spawn(*p);
+	}
+
+	scheduler.run(seconds);
+	scheduler.printStatistics(std::cout);
+
+	return loaded;
+}
+
+void benchmarkScheduler(size_t count, unsigned int threads, size_t budget)
+{
+	// ports 1 and 2 are the outside, the pipelines start at 10
+	std::vector<std::string> sources;
+
+	const std::string spin = "PROGRAM SPIN;\nBEGIN\n1: X := 1;\nY := 2;\nGOTO 1;\nEND;\n";
+	const std::string brief = "PROGRAM BRIEF;\nBEGIN\nX := 1;\nY := 2;\nP (X, Y);\nRETURN;\nEND;\n";
+
+	size_t pipelines = count / 12;
+	for (size_t i = 0; i < pipelines; i++)
+	{
+		std::string first = std::to_string(10 + 2 * i);
+		std::string second = std::to_string(11 + 2 * i);
+
+		sources.push_back("PROGRAM PRODUCER;\nBEGIN\nLINK V, " + first + ";\n1: V := 7;\nOUT " + first + ";\nGOTO 1;\nEND;\n");
+		sources.push_back("PROGRAM RELAY;\nBEGIN\nLINK V, " + first + ";\nLINK V, " + second + ";\n1: IN " + first + ";\nOUT " + second + ";\nGOTO 1;\nEND;\n");
+		sources.push_back("PROGRAM CONSUMER;\nBEGIN\nLINK V, " + second + ";\n1: IN " + second + ";\nGOTO 1;\nEND;\n");
+	}
+	sources.push_back("PROGRAM RELAY;\nBEGIN\nLINK V, 1;\nLINK V, 2;\n1: IN 1;\nOUT 2;\nGOTO 1;\nEND;\n");
+	sources.push_back(spin);
+	sources.push_back(brief);
+
+	std::vector<std::unique_ptr<ExecutableProgram>> programs;
+	for (auto const& s : sources)
+	{
+		programs.push_back(std::make_unique<ExecutableProgram>());
+		if (!loadProgram(SourceText{ s }, "benchmark", *programs.back()))
+			return;
+	}
+
+	const ExecutableProgram& spinning = *programs[programs.size() - 2];
+	const ExecutableProgram& briefly = *programs[programs.size() - 1];
+
+	std::vector<unsigned int> source(100000);
+	for (size_t i = 0; i < source.size(); i++)
+		source[i] = (unsigned int)i;
+
+	std::vector<unsigned int> counts = { 1 };
+	unsigned int all = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	if (all > 1)
+		counts.push_back(all);
+
+	for (unsigned int n : counts)
+	{
+		std::vector<unsigned int> sink;
+
+		Scheduler scheduler(n, budget);
+		scheduler.bind(1, std::make_unique<MemoryDevice>(&source, nullptr));
+		scheduler.bind(2, std::make_unique<MemoryDevice>(nullptr, &sink));
+
+		// the pipelines and the outside relay, then half loops and half short programs
+		for (size_t i = 0; i + 2 < programs.size(); i++)
+			scheduler.spawn(*programs[i]);
+		for (size_t i = 3 * pipelines + 1; i < count; i++)
+			scheduler.spawn(i % 2 == 0 ? spinning : briefly);
+
+		scheduler.run(1);
+		scheduler.printStatistics(std::cout);
+
+		std::cout << "Scheduler: " << sink.size() << " of " << source.size() << " words relayed from port 1 to port 2"
+			<< (std::equal(sink.begin(), sink.end(), source.begin()) ? "" : ", out of order") << std::endl;
+	}
+}
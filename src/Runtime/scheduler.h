@@ -0,0 +1,158 @@
+#pragma once
+
+#include "ports.h"
+#include "../Optimizer/optimizer.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <unordered_map>
+
+// Statement of a loaded program, names resolved to slots and indexes
+struct Instruction
+{
+	StatementKind kind = StatementKind::Empty;
+	int variable = -1; // Assign, Link
+	unsigned int value = 0; // Assign: constant, Link, In, Out: port
+	int target = -1; // Goto: statement index
+};
+
+// A parsed program that any number of tasks run at once
+struct ExecutableProgram
+{
+	std::string name = "";
+	std::vector<Instruction> code;
+	std::vector<std::string> variables;
+
+	// false with a message when a GOTO has no label to go to
+	bool load(const FlatProgram&, std::string&);
+};
+
+enum class TaskState
+{
+	Runnable, // queued or running
+	Parked, // waits in IN for a word or in OUT for room
+	Done, // RETURN or the end of the program
+	Stopped // still runnable when the run ended
+};
+
+// One running instance of a program
+struct Task
+{
+	size_t id = 0;
+	const ExecutableProgram* program = nullptr;
+	TaskState state = TaskState::Runnable;
+
+	int pc = 0;
+	std::vector<unsigned int> values; // by variable
+	std::vector<std::pair<unsigned int, int>> links; // port, variable in LINK order
+
+	size_t statements = 0;
+	size_t slices = 0;
+	size_t parks = 0;
+
+	std::chrono::steady_clock::time_point queuedAt;
+	double waitSeconds = 0; // runnable but not running
+	double maxWaitSeconds = 0;
+
+	std::chrono::steady_clock::time_point runnableAt; // since it last started or woke
+	double runnableSeconds = 0; // queued or running, up to the last park or the end
+};
+
+// A port shared by all tasks. OUT appends a word and parks while the port is
+// full, IN takes the oldest word and parks while there is none. A port bound
+// to a device reads and writes the device instead and never parks a writer,
+// its readers park until the scheduler polls new words from the device.
+struct Channel
+{
+	std::mutex lock;
+	std::deque<unsigned int> words;
+	size_t capacity = 0;
+
+	std::deque<Task*> readers; // parked in IN
+	std::deque<Task*> writers; // parked in OUT
+
+	std::unique_ptr<Port> port;
+};
+
+// Runs tasks (M) on worker threads (N). Every worker owns a queue: it takes
+// tasks from the front and puts preempted and woken tasks at the back, idle
+// workers steal from the back of the others. A task yields at a GOTO back to
+// an earlier statement once it has run its budget of statements, since only
+// loops can run for long; blocking IN and OUT park it on the port until
+// another task or the device makes progress possible.
+class Scheduler
+{
+private:
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<Task*> queue;
+
+		size_t slices = 0;
+		size_t steals = 0;
+	};
+
+	unsigned int threads;
+	size_t budget;
+	size_t portCapacity;
+
+	std::vector<std::unique_ptr<Task>> tasks;
+	std::unordered_map<unsigned int, std::unique_ptr<Channel>> channels; // fixed while running
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::atomic<size_t> live{ 0 }; // tasks queued or running, parked ones can't wake anybody
+	std::atomic<bool> stopping{ false };
+	double elapsed = 0;
+
+public:
+	Scheduler(unsigned int = 0, size_t = 1000, size_t = 1024);
+
+	Task* spawn(const ExecutableProgram&);
+	// false when reading the device could stall a worker
+	bool bind(unsigned int, std::unique_ptr<PortDevice>);
+
+	// until every task is done or parked for good, or the seconds are up;
+	// readers of a device wait for it until it ends
+	void run(double);
+
+	const std::vector<std::unique_ptr<Task>>& getTasks() const { return tasks; }
+	unsigned int threadCount() const { return threads; }
+	size_t statementCount() const;
+
+	// Jain's index of the statements run by the tasks that never parked and
+	// never finished: 1 when they all got the same share of the workers.
+	// Only endless loops count, pipelines and short programs don't.
+	double fairness() const;
+	// Jain's index of the statements per second runnable of every task that
+	// was runnable at all, so parked and finished tasks count too
+	double runnableFairness() const;
+
+	void printStatistics(std::ostream&) const;
+
+private:
+	Channel& channel(unsigned int);
+	static void leaveRunnable(Task&, TaskState);
+
+	void work(size_t);
+	Task* next(size_t);
+	void schedule(size_t, Task*);
+	void execute(size_t, Task&);
+
+	bool pollPorts();
+
+	bool in(Task&, const Instruction&, size_t);
+	bool out(Task&, const Instruction&, size_t);
+};
+
+// Loads the programs of the files and runs copies of each of them
+bool runPrograms(const std::vector<std::string>&, size_t, unsigned int, size_t, double);
+
+// Statements per second and fairness of a mixed workload: loops that never
+// block, producer, relay and consumer pipelines and short programs
+void benchmarkScheduler(size_t, unsigned int, size_t);
@@ -0,0 +1,219 @@
+#include "stress.h"
+#include "../Lexer/lexer.h"
+#include "../Parser/parser.h"
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+StressSuite::StressSuite(const std::string& filename) : workFile(filename)
+{
+	initializeCases();
+}
+
+void StressSuite::initializeCases()
+{
+	const std::string head = "PROGRAM STRESS;\nBEGIN\n";
+	const std::string tail = "\nEND;\n";
+
+	cases.push_back({ "comment full of '*'", [=](size_t n)
+		{
+			return head + "(*" + std::string(n, '*') + ")" + tail;
+		}, 1 << 18, false });
+
+	cases.push_back({ "comment full of '*('", [=](size_t n)
+		{
+			std::string s = head + "(*";
+			for (size_t i = 0; i < n / 2; i++)
+				s += "*(";
+			return s + "*)" + tail;
+		}, 1 << 18, false });
+
+	cases.push_back({ "unterminated comment", [=](size_t n)
+		{
+			std::string s = head + "(*";
+			for (size_t i = 0; i < n / 2; i++)
+				s += "* ";
+			return s;
+		}, 1 << 18, false });
+
+	cases.push_back({ "illegal characters", [=](size_t n)
+		{
+			std::string s;
+			for (size_t i = 0; i < n; i++)
+				s += "?@!~"[i % 4];
+			return s;
+		}, 1 << 16, false });
+
+	cases.push_back({ "long identifier", [=](size_t n)
+		{
+			return head + "V" + std::string(n, 'A') + " := 1;" + tail;
+		}, 1 << 18, true });
+
+	cases.push_back({ "distinct identifiers", [=](size_t n)
+		{
+			std::string s = head;
+			for (size_t i = 0; i < n; i++)
+				s += "V" + std::to_string(i) + " := 1;\n";
+			return s + tail;
+		}, 1 << 11, true });
+
+	cases.push_back({ "missing END", [=](size_t n)
+		{
+			std::string s = head;
+			for (size_t i = 0; i < n; i++)
+				s += "IN 5;\n";
+			return s;
+		}, 1 << 11, true });
+
+	cases.push_back({ "distinct constants", [=](size_t n)
+		{
+			std::string s = head;
+			for (size_t i = 0; i < n; i++)
+				s += "GOTO " + std::to_string(i) + ";\n";
+			return s + tail;
+		}, 1 << 11, true });
+}
+
+bool StressSuite::run()
+{
+	bool passed = true;
+
+	for (auto const& c : cases)
+	{
+		if (!check(c))
+			passed = false;
+	}
+
+	if (!checkPipe())
+		passed = false;
+
+	std::remove(workFile.c_str());
+
+	std::cout << (passed ? "Stress: all cases scale linearly" : "Stress: superlinear scaling detected") << std::endl;
+	return passed;
+}
+
+bool StressSuite::check(const StressCase& c)
+{
+	std::cout << c.name << ":" << std::endl;
+
+	std::vector<double> times;
+	size_t n = c.size;
+
+	for (int i = 0; i < steps; i++, n *= 2)
+	{
+		double t = measure(c.generate(n), c.parse);
+		times.push_back(t);
+
+		std::cout << "\t" << n << "\t" << t * 1000 << " ms";
+		if (i > 0 && times[i - 1] > 0)
+			std::cout << "\tx" << t / times[i - 1];
+		std::cout << std::endl;
+	}
+
+	// average growth per doubling over the steps that are long enough to measure
+	int first = 0;
+	while (first < steps - 1 && times[first] < minSeconds)
+		first++;
+
+	int doublings = steps - 1 - first;
+	if (doublings == 0)
+		return true;
+
+	double growth = std::pow(times[steps - 1] / times[first], 1.0 / doublings);
+	if (growth > maxRatio)
+	{
+		std::cout << "\tFAILED: time grows x" << growth << " per doubling" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool StressSuite::checkPipe()
+{
+#ifndef _WIN32
+	std::cout << "input from a FIFO:" << std::endl;
+
+	std::string source = "PROGRAM PIPE;\nBEGIN\n";
+	for (int i = 0; i < 20000; i++)
+		source += "V" + std::to_string(i % 100) + " := " + std::to_string(i % 500) + ";\n";
+	source += "END;\n";
+
+	{
+		std::ofstream out(workFile, std::ios::binary);
+		out << source;
+	}
+	Lexer expected;
+	expected.startLexicalAnalyzer(workFile);
+
+	std::string fifo = workFile + ".fifo";
+	std::remove(fifo.c_str());
+	if (mkfifo(fifo.c_str(), 0600) != 0)
+	{
+		std::cout << "\tskipped: can't create " << fifo << std::endl;
+		return true;
+	}
+
+	// larger than the pipe buffer, so the lexer reads while it is written
+	std::thread writer([&]()
+	{
+		std::ofstream out(fifo, std::ios::binary);
+		out << source;
+	});
+
+	Lexer lexer;
+	lexer.startLexicalAnalyzer(fifo);
+	writer.join();
+	std::remove(fifo.c_str());
+
+	bool same = lexer.tokens.size() == expected.tokens.size() && lexer.errors.size() == expected.errors.size();
+	for (size_t i = 0; same && i < lexer.tokens.size(); i++)
+		same = lexer.tokens[i].id == expected.tokens[i].id && lexer.tokens[i].offset == expected.tokens[i].offset;
+
+	std::cout << "\t" << lexer.tokens.size() << " tokens, " << (same ? "same as from the file" : "FAILED: differs from the file") << std::endl;
+	return same;
+#else
+	return true;
+#endif
+}
+
+double StressSuite::measure(const std::string& source, bool parse)
+{
+	{
+		std::ofstream out(workFile, std::ios::binary);
+		out << source;
+	}
+
+	double best = -1;
+
+	for (int i = 0; i < repeats; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		if (parse)
+		{
+			Parser par(workFile, "", "");
+			par.startParsing();
+		}
+		else
+		{
+			Lexer lexer;
+			lexer.startLexicalAnalyzer(workFile);
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (best < 0 || elapsed.count() < best)
+			best = elapsed.count();
+	}
+
+	return best;
+}
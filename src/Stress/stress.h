@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct StressCase
+{
+	std::string name = "";
+	std::function<std::string(size_t)> generate;
+	size_t size = 0; // first size, doubled on every step
+	bool parse = false; // time the parser too, not only the lexer
+};
+
+// Runs the lexer and parser on adversarial inputs of doubling size and
+// fails when the running time grows faster than near-linear.
+class StressSuite
+{
+private:
+	std::vector<StressCase> cases;
+	std::string workFile;
+
+	int steps = 5;
+	int repeats = 3;
+	double maxRatio = 3.0; // linear is 2.0 per doubling, quadratic is 4.0
+	double minSeconds = 0.002; // shorter runs are too noisy to compare
+
+public:
+	StressSuite(const std::string&);
+
+	bool run();
+
+private:
+	void initializeCases();
+
+	bool check(const StressCase&);
+	bool checkPipe(); // the lexer reads input that can't seek
+	double measure(const std::string&, bool);
+};
@@ -0,0 +1,283 @@
+#include "watch.h"
+
+#include <iostream>
+#include <chrono>
+#include <filesystem>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+WatchMode::WatchMode(const std::string& directory, AsmResolver* r, ParserEngine e) :
+	root(directory), resolver(r), engine(e)
+{
+	// event paths are built as directory + "/" + name
+	while (root.size() > 1 && (root.back() == '/' || root.back() == '\\'))
+		root.pop_back();
+}
+
+WatchMode::~WatchMode()
+{
+#ifdef __linux__
+	if (notify >= 0)
+		close(notify);
+#endif
+}
+
+bool WatchMode::isProgram(const std::string& path)
+{
+	return path.size() > 4 && path.compare(path.size() - 4, 4, ".sig") == 0;
+}
+
+bool WatchMode::isOutput(const std::string& path)
+{
+	auto ends = [&](const char* suffix)
+	{
+		std::string s = suffix;
+		return path.size() >= s.size() && path.compare(path.size() - s.size(), s.size(), s) == 0;
+	};
+
+	return ends(".lex.txt") || ends(".par.txt");
+}
+
+void WatchMode::scan(const std::string& directory, std::unordered_set<std::string>& found)
+{
+	std::error_code ec;
+	std::filesystem::recursive_directory_iterator i(directory, ec), end;
+
+	for (; i != end; i.increment(ec))
+	{
+		if (i->is_directory(ec))
+			watchDirectory(i->path().string());
+		else if (isProgram(i->path().string()))
+			found.insert(i->path().string());
+	}
+}
+
+void WatchMode::build(const std::string& path)
+{
+	Parser par(path, path + ".lex.txt", path + ".par.txt");
+	par.setResolver(resolver);
+	par.setEngine(engine);
+	par.startParsing();
+
+	Program& program = programs[path];
+	for (auto const& name : program.inserts)
+		dependents[name].erase(path);
+
+	std::error_code ec;
+	program.inserts = par.getInserts();
+	program.failed = par.hasErrors();
+	program.modified = std::filesystem::last_write_time(path, ec);
+
+	for (auto const& name : program.inserts)
+	{
+		dependents[name].insert(path);
+		inserts[name] = insertState(name);
+	}
+}
+
+WatchMode::InsertState WatchMode::insertState(const std::string& name)
+{
+	InsertState state;
+	const AsmInsert* insert = resolver->resolve(name);
+	if (insert != nullptr)
+	{
+		std::error_code ec;
+		state.path = insert->path;
+		state.modified = std::filesystem::last_write_time(insert->path, ec);
+	}
+
+	return state;
+}
+
+// finds changes by modification time when events were lost
+void WatchMode::resync(std::unordered_set<std::string>& affected)
+{
+	std::unordered_set<std::string> found;
+	scan(root, found);
+
+	std::vector<std::string> removed;
+	for (auto const& i : programs)
+	{
+		if (found.count(i.first) == 0)
+			removed.push_back(i.first);
+	}
+	for (auto const& path : removed)
+		remove(path);
+
+	for (auto const& path : found)
+	{
+		std::error_code ec;
+		auto i = programs.find(path);
+		if (i == programs.end() || i->second.modified != std::filesystem::last_write_time(path, ec))
+			affected.insert(path);
+	}
+
+	for (auto const& i : dependents)
+	{
+		if (i.second.empty())
+			continue;
+
+		resolver->invalidate(i.first);
+		InsertState state = insertState(i.first);
+		InsertState& old = inserts[i.first];
+
+		if (state.path != old.path || state.modified != old.modified)
+			affected.insert(i.second.begin(), i.second.end());
+	}
+}
+
+void WatchMode::remove(const std::string& path)
+{
+	auto i = programs.find(path);
+	if (i == programs.end())
+		return;
+
+	for (auto const& name : i->second.inserts)
+		dependents[name].erase(path);
+
+	programs.erase(i);
+}
+
+void WatchMode::changed(const std::string& path, bool removed, std::unordered_set<std::string>& affected)
+{
+	if (isOutput(path))
+		return;
+
+	if (isProgram(path))
+	{
+		if (removed)
+		{
+			remove(path);
+			affected.erase(path);
+		}
+		else
+			affected.insert(path);
+	}
+
+	// the file may be an insert under any of the names the resolver tries
+	std::string name = std::filesystem::path(path).filename().string();
+	std::vector<std::string> names = { name };
+	for (const char* ext : { ".asm", ".inc" })
+	{
+		std::string e = ext;
+		if (name.size() > e.size() && name.compare(name.size() - e.size(), e.size(), e) == 0)
+			names.push_back(name.substr(0, name.size() - e.size()));
+	}
+
+	for (auto const& n : names)
+	{
+		auto users = dependents.find(n);
+		if (users == dependents.end())
+			continue;
+
+		resolver->invalidate(n);
+		affected.insert(users->second.begin(), users->second.end());
+	}
+}
+
+#ifdef __linux__
+
+bool WatchMode::watchDirectory(const std::string& directory)
+{
+	int wd = inotify_add_watch(notify, directory.c_str(),
+		IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+	if (wd < 0)
+	{
+		std::cout << "Watch: Error: Can't watch directory " << directory << std::endl;
+		return false;
+	}
+
+	directories[wd] = directory;
+	return true;
+}
+
+bool WatchMode::run()
+{
+	notify = inotify_init1(IN_CLOEXEC);
+	if (notify < 0 || !watchDirectory(root))
+	{
+		std::cout << "Watch: Error: Can't watch " << root << std::endl;
+		return false;
+	}
+
+	std::unordered_set<std::string> affected;
+	scan(root, affected);
+	for (auto const& path : affected)
+		build(path);
+
+	std::cout << "Watch: " << programs.size() << " programs, " << directories.size()
+		<< " directories, waiting for changes" << std::endl;
+
+	alignas(inotify_event) char buffer[64 * 1024];
+	while (true)
+	{
+		long length = (long)read(notify, buffer, sizeof(buffer));
+		if (length <= 0)
+			return false;
+
+		auto start = std::chrono::steady_clock::now();
+		affected.clear();
+
+		for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+		{
+			const inotify_event* event = (const inotify_event*)p;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				// events were lost, our own output files are enough to overflow the queue
+				resync(affected);
+				continue;
+			}
+
+			auto dir = directories.find(event->wd);
+			if (dir == directories.end() || event->len == 0)
+				continue;
+
+			std::string path = dir->second + "/" + event->name;
+
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO))
+				{
+					watchDirectory(path);
+					scan(path, affected);
+				}
+				continue;
+			}
+
+			// a created file is built once it is written and closed
+			if (event->mask & IN_CREATE)
+				continue;
+
+			changed(path, (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0, affected);
+		}
+
+		if (affected.empty())
+			continue;
+
+		for (auto const& path : affected)
+			build(path);
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Watch: rebuilt " << affected.size() << " programs in "
+			<< elapsed.count() * 1000 << " ms" << std::endl;
+	}
+}
+
+#else
+
+bool WatchMode::watchDirectory(const std::string&)
+{
+	return false;
+}
+
+bool WatchMode::run()
+{
+	std::cout << "Watch: Error: watch mode needs inotify (Linux)" << std::endl;
+	return false;
+}
+
+#endif
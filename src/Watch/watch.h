@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../Parser/parser.h"
+#include "../Resolver/resolver.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+
+// Rebuilds the programs of a directory tree whenever their files change.
+// Every program remembers the insert files it uses, so a change only
+// re-lexes and re-parses the programs that depend on the changed file.
+class WatchMode
+{
+private:
+	struct Program
+	{
+		std::vector<std::string> inserts; // "($ NAME $)" names
+		bool failed = false;
+		std::filesystem::file_time_type modified;
+	};
+
+	struct InsertState
+	{
+		std::string path = ""; // empty when the insert is missing
+		std::filesystem::file_time_type modified;
+	};
+
+	std::string root;
+	AsmResolver* resolver;
+	ParserEngine engine;
+
+	std::unordered_map<std::string, Program> programs; // by path
+	std::unordered_map<std::string, std::unordered_set<std::string>> dependents; // insert name -> program paths
+	std::unordered_map<std::string, InsertState> inserts; // by name, as seen by the last build
+
+	int notify = -1;
+	std::unordered_map<int, std::string> directories; // watch descriptor -> path
+
+public:
+	WatchMode(const std::string&, AsmResolver*, ParserEngine);
+	~WatchMode();
+
+	// builds everything, then waits for changes; false when watching can't start
+	bool run();
+
+private:
+	void scan(const std::string&, std::unordered_set<std::string>&);
+	bool watchDirectory(const std::string&);
+
+	void build(const std::string&);
+	void remove(const std::string&);
+	void changed(const std::string&, bool, std::unordered_set<std::string>&);
+	void resync(std::unordered_set<std::string>&);
+
+	InsertState insertState(const std::string&);
+
+	static bool isProgram(const std::string&);
+	static bool isOutput(const std::string&);
+};
@@ -1,19 +1,317 @@
 #include "Lexer/lexer.h"
 #include "Parser/parser.h"
+#include "Resolver/resolver.h"
+#include "Stress/stress.h"
+#include "Runtime/ports.h"
+#include "Runtime/scheduler.h"
+#include "Linker/linker.h"
+#include "Watch/watch.h"
+#include "Optimizer/optimizer.h"
+#include "Pipe/pipe.h"
+#include "Profile/profile.h"
+#include "Differential/differential.h"
+#include "Loader/loader.h"
+#include "Publish/publish.h"
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <memory>
+#include <random>
 
-int main()
+int main(int argc, char* argv[])
 {
 	std::string path = "../tests/";
 
-	std::cout << "File name: ";
-	std::string filename;
-	std::getline(std::cin, filename);
-	
-	Parser par(path + filename);
-	par.startParsing();
+	AsmResolver resolver;
+	std::vector<std::string> files;
+	bool stress = false;
+	size_t portOps = 0;
+	std::string benchParser;
+	std::string benchStorage;
+	ParserEngine engine = ParserEngine::Table;
+	bool link = false;
+	unsigned int threads = 0;
+	std::string watch;
+	bool streaming = false;
+	bool optimize = false;
+	bool fromStdin = false;
+	bool profile = false;
+	size_t differential = 0;
+	size_t copies = 0;
+	std::string reference;
+	bool benchLoad = false;
+	std::string loadMethod;
+	std::string publish;
+	std::string published;
+	std::string benchPublish;
+	size_t schedulerTasks = 0;
+	size_t budget = 1000;
+	double seconds = 1;
+	unsigned int seed = std::random_device()();
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "-I" && i + 1 < argc)
+			resolver.addSearchPath(argv[++i]);
+		else if (arg == "--stress")
+			stress = true;
+		else if (arg == "--bench-ports" && i + 1 < argc)
+			portOps = std::stoul(argv[++i]);
+		else if (arg == "--bench-parser" && i + 1 < argc)
+			benchParser = argv[++i];
+		else if (arg == "--bench-storage" && i + 1 < argc)
+			benchStorage = argv[++i];
+		else if (arg == "--watch" && i + 1 < argc)
+			watch = argv[++i];
+		else if (arg == "--stream")
+			streaming = true;
+		else if (arg == "--stdin" || arg == "-")
+			fromStdin = true;
+		else if (arg == "--differential" && i + 1 < argc)
+			differential = std::stoul(argv[++i]);
+		else if (arg == "--seed" && i + 1 < argc)
+			seed = (unsigned int)std::stoul(argv[++i]);
+		else if (arg == "--run" && i + 1 < argc)
+			copies = std::stoul(argv[++i]);
+		else if (arg == "--bench-scheduler" && i + 1 < argc)
+			schedulerTasks = std::stoul(argv[++i]);
+		else if (arg == "--budget" && i + 1 < argc)
+			budget = std::stoul(argv[++i]);
+		else if (arg == "--seconds" && i + 1 < argc)
+			seconds = std::stod(argv[++i]);
+		else if (arg == "--xref" && i + 1 < argc)
+			reference = argv[++i];
+		else if (arg == "--bench-load")
+			benchLoad = true;
+		else if (arg == "--load" && i + 1 < argc)
+			loadMethod = argv[++i];
+		else if (arg == "--publish" && i + 1 < argc)
+			publish = argv[++i];
+		else if (arg == "--published" && i + 1 < argc)
+			published = argv[++i];
+		else if (arg == "--bench-publish" && i + 1 < argc)
+			benchPublish = argv[++i];
+		else if (arg == "--profile")
+			profile = true;
+		else if (arg == "--optimize")
+			optimize = true;
+		else if (arg == "--link")
+			link = true;
+		else if (arg == "-j" && i + 1 < argc)
+			threads = (unsigned int)std::stoul(argv[++i]);
+		else if (arg == "--recursive-descent")
+			engine = ParserEngine::RecursiveDescent;
+		else if (arg == "--parallel")
+			engine = ParserEngine::Parallel;
+		else
+			files.push_back(arg);
+	}
+
+	if (streaming && engine == ParserEngine::Parallel)
+	{
+		// the workers need every token and build the whole tree
+		std::cout << "Error: --stream can't be used with --parallel" << std::endl;
+		return 1;
+	}
+
+	if (stress)
+	{
+		StressSuite suite((std::filesystem::temp_directory_path() / "signal_stress.sig").string());
+		return suite.run() ? 0 : 1;
+	}
+
+	if (differential > 0)
+	{
+		std::cout << "Differential: seed " << seed << std::endl;
+		DifferentialSuite suite(path, seed);
+		return suite.run(differential) ? 0 : 1;
+	}
+
+	if (portOps > 0)
+	{
+		benchmarkPorts(portOps, (std::filesystem::temp_directory_path() / "signal_ports.bin").string());
+		return 0;
+	}
+
+	if (!reference.empty())
+		return findReferences(reference, files) ? 0 : 1;
+
+	if (!published.empty())
+		return showPublished(published) ? 0 : 1;
+
+	if (!benchPublish.empty())
+	{
+		benchmarkPublishing(benchPublish);
+		return 0;
+	}
+
+	if (benchLoad)
+	{
+		benchmarkLoading(files, threads);
+		return 0;
+	}
+
+	if (schedulerTasks > 0)
+	{
+		benchmarkScheduler(schedulerTasks, threads, budget);
+		return 0;
+	}
+
+	if (copies > 0)
+		return runPrograms(files, copies, threads, budget, seconds) ? 0 : 1;
+
+	if (!benchParser.empty())
+	{
+		benchmarkParsers(benchParser, threads);
+		return 0;
+	}
+
+	if (!benchStorage.empty())
+	{
+		benchmarkStorage(benchStorage, 10000);
+		return 0;
+	}
+
+	if (optimize)
+	{
+		optimizePrograms(files);
+		return 0;
+	}
+
+	if (link)
+	{
+		Linker linker(threads);
+		for (auto const& filename : files)
+			linker.addProgram(filename);
+
+		auto start = std::chrono::steady_clock::now();
+		bool linked = linker.link();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		for (auto const& i : linker.getErrors())
+			std::cout << i << std::endl;
+
+		std::cout << "Linker: " << linker.programCount() << " programs, "
+			<< linker.symbolCount() << " symbols, " << linker.getErrors().size() << " errors, "
+			<< elapsed.count() * 1000 << " ms on " << linker.threadCount() << " threads" << std::endl;
+
+		return linked ? 0 : 1;
+	}
+
+	if (!watch.empty())
+	{
+		// inserts next to the programs are tracked, the other search paths are only read
+		resolver.addSearchPath(watch);
+		resolver.addSearchPath(path);
+
+		WatchMode watcher(watch, &resolver, engine);
+		return watcher.run() ? 0 : 1;
+	}
+
+	resolver.addSearchPath(path);
+
+	// hardware counters per phase and file, printed after the run
+	std::unique_ptr<Profiler> profiler;
+	if (profile)
+	{
+		profiler = std::make_unique<Profiler>();
+		Profiler::setCurrent(profiler.get());
+	}
+
+	if (fromStdin)
+	{
+		std::ios::sync_with_stdio(false);
+		bool compiled = compileStream(std::cin, &resolver, engine);
+
+		if (profiler)
+			profiler->print();
+		return compiled ? 0 : 1;
+	}
+
+	if (files.empty())
+	{
+		std::cout << "File name: ";
+		std::string filename;
+		std::getline(std::cin, filename);
+
+		Parser par(path + filename);
+		par.setResolver(&resolver);
+		par.setEngine(engine);
+		par.setStreaming(streaming);
+		par.startParsing();
+
+		return 0;
+	}
+
+	// batch: one resolver is shared by every compilation unit
+	auto compile = [&](Parser& par, size_t index)
+	{
+		par.setResolver(&resolver);
+		par.setEngine(engine);
+		par.setThreads(threads);
+		par.setStreaming(streaming && publish.empty()); // publishing needs the tree
+		par.startParsing();
+
+		if (!publish.empty())
+		{
+			// the only file is published under the name, more files get their index appended
+			std::string name = files.size() == 1 ? publish : publish + "." + std::to_string(index);
+			std::string error;
+			if (publishResults(name, par, error))
+				std::cout << "Results were published in: \"" << publishedObjectName(name) << "\"" << std::endl;
+			else
+				std::cout << "Publish: Error: " << error << std::endl;
+		}
+	};
+
+	if (!loadMethod.empty())
+	{
+		// files are compiled in the order they are read, still on this thread
+		FileLoader loader(files, loadMethod == "uring" ? LoadMethod::Uring : LoadMethod::Pread, threads);
+		LoadedFile file;
+		while (loader.next(file))
+		{
+			if (profiler)
+				profiler->beginFile(file.filename);
+
+			if (!file.loaded)
+			{
+				// the lexer reports the file it can't open
+				Parser par(file.filename, file.filename + ".lex.txt", file.filename + ".par.txt");
+				compile(par, file.index);
+				continue;
+			}
+
+			Parser par(SourceText{ file.text }, file.filename + ".lex.txt", file.filename + ".par.txt");
+			compile(par, file.index);
+		}
+
+		std::cout << "Loader: " << files.size() << " files read with " << loadMethodName(loader.loadMethod())
+			<< ", " << loader.systemCalls() << " system calls" << std::endl;
+	}
+	else
+	{
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			if (profiler)
+				profiler->beginFile(files[i]);
+
+			Parser par(files[i], files[i] + ".lex.txt", files[i] + ".par.txt");
+			compile(par, i);
+		}
+	}
+
+	std::cout << "Assembly inserts: " << resolver.lookupCount() << " references, "
+		<< resolver.mappedCount() << " files mapped, "
+		<< resolver.uniqueCount() << " unique" << std::endl;
+
+	if (profiler)
+		profiler->print();
 
 	return 0;
 }